@@ -12,7 +12,8 @@
       8   | 25:0 | mem_read  |  R/W |memory read offset in words
      12   | 25:0 | mem_write |  R   |memory write offset in words
      16   |    0 | control   |  W   | bit 0: enable
-     16   |  2:0 | status    |  R   | {fifo_ovfl, ram_ovfl, running}
+     16   |  3:0 | status    |  R   | {threshold, fifo_ovfl, ram_ovfl, running}
+     20   | 25:0 | mem_thres |  R/W |fill level threshold in words (0 = off)
 */
 
 module daq_dma32
@@ -62,6 +63,7 @@ module daq_dma32
 	reg [26:1]mem_size;
 	reg [26:1]mem_read;
 	reg [26:1]mem_write;
+	reg [26:1]mem_thres;
 	reg  next2;
 	
 	reg start;
@@ -79,6 +81,16 @@ module daq_dma32
 	wire [26:1]next_addr = carry ? 26'd0 : inc_addr;
 	wire overflow = next_addr == mem_read;
 
+	// fill level threshold flag (registered)
+	wire [26:1]fill = (mem_write >= mem_read) ?
+		mem_write - mem_read : mem_write - mem_read + mem_size;
+	reg threshold;
+	always @(posedge clk or posedge reset)
+	begin
+		if (reset) threshold <= 0;
+		else threshold <= (mem_thres != 0) && (fill >= mem_thres);
+	end
+
 
 	always @(posedge clk or posedge reset)
 	begin
@@ -91,6 +103,7 @@ module daq_dma32
 			mem_size    <= 0;
 			mem_write   <= 0;
 			mem_read    <= 0;
+			mem_thres   <= 0;
 			start       <= 0;
 			running_int <= 0;
 			fifo_ovfl   <= 0;
@@ -99,6 +112,8 @@ module daq_dma32
 		else
 		begin
 			start <= set_start;
+			if (avs_ctrl_write && (avs_ctrl_address == 5))
+				mem_thres <= avs_ctrl_writedata[25:0];
 			if (running_int)
 			begin
 				if (dreg_write) {dreg, dreg_empty} = {data, 1'b0};
@@ -145,7 +160,8 @@ module daq_dma32
 			1: avs_ctrl_readdata <= {6'b000000, mem_size  };
 			2: avs_ctrl_readdata <= {6'b000000, mem_read  };
 			3: avs_ctrl_readdata <= {6'b000000, mem_write };
-			default: avs_ctrl_readdata <= {29'b0, fifo_ovfl, ram_ovfl, running_int};
+			5: avs_ctrl_readdata <= {6'b000000, mem_thres };
+			default: avs_ctrl_readdata <= {28'b0, threshold, fifo_ovfl, ram_ovfl, running_int};
 		endcase
 	end
 
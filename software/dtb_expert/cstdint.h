@@ -2,6 +2,10 @@
 
 #pragma once
 
+#ifdef DTB_SIM // host build: use the host types
+#include <stdint.h>
+#else
+
 typedef char int8_t;
 typedef short int16_t;
 typedef int int32_t;
@@ -11,3 +15,5 @@ typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
 typedef unsigned int uint32_t;
 typedef unsigned long long uint64_t;
+
+#endif
@@ -0,0 +1,186 @@
+// daq_map.cc
+// DAQ pixel map mode: the DAQ buffers are decoded on board while a
+// calibrate loop runs. The host reads the hit count and pulse height
+// maps instead of the raw data. In DAC scans an efficiency curve per
+// pixel is filled and the 50% threshold can be extracted on board.
+
+#include "pixel_dtb.h"
+#include "sys/alt_alarm.h"
+#include "sys/alt_cache.h"
+
+
+// max time to wait for the events of a bin (system ticks)
+#define DAQ_MAP_TIMEOUT 2
+
+
+bool CTestboard::Daq_MapStart(uint8_t nrocs, uint8_t rocs_per_channel, uint16_t nbins)
+{
+	daq_map_active = false;
+	if (!daq_map.Init(nrocs, rocs_per_channel,
+		daq_select_deser400, roc_pixeladdress_inverted, nbins)) return false;
+
+	// discard old data
+	for (uint8_t ch = 0; ch < DAQ_CHANNELS; ch++)
+	{
+		daq_map_expected[ch] = 0;
+		if (daq_mem_base[ch] && !(daq_stream_mask & (1 << ch)))
+		{
+			unsigned int daq_base = DAQ_DMA_BASE[ch];
+			DAQ_WRITE(daq_base, DAQ_MEM_READ, DAQ_READ(daq_base, DAQ_MEM_WRITE));
+		}
+	}
+
+	daq_map_wait = Daq_DataChannels() & ~daq_stream_mask;
+	daq_map_timeouts = 0;
+	daq_map_missing = 0;
+	daq_map_active = true;
+	return true;
+}
+
+
+uint32_t CTestboard::Daq_MapStop(uint32_t &errors)
+{
+	Daq_MapUpdate();
+	daq_map_active = false;
+	errors = daq_map.GetErrors();
+	return daq_map.GetEvents();
+}
+
+
+// Decodes and removes all data in the DAQ buffers.
+// Called by the trigger loops and before the maps are read.
+void CTestboard::Daq_MapUpdate()
+{
+	if (!daq_map_active) return;
+
+	for (uint8_t ch = 0; ch < DAQ_CHANNELS; ch++)
+	{
+		if (daq_mem_base[ch] == 0 || (daq_stream_mask & (1 << ch))) continue;
+
+		// read dma status
+		unsigned int daq_base = DAQ_DMA_BASE[ch];
+		int32_t status = DAQ_READ(daq_base, DAQ_CONTROL) ^ 1;
+		int32_t rp = DAQ_READ(daq_base, DAQ_MEM_READ);
+		int32_t wp = DAQ_READ(daq_base, DAQ_MEM_WRITE);
+
+		// correct write pointer overrun at memory overflow
+		if (status & DAQ_MEM_OVFL) if (--wp < 0) wp += daq_mem_size[ch];
+		if (wp == rp) continue;
+
+		// decode in one or two parts (ring buffer wrap around), cached
+		// reads after the stale lines are dropped (see Daq_Copy)
+		uint16_t *p = daq_mem_base[ch];
+		if (wp < rp)
+		{
+			alt_dcache_flush_no_writeback(p + rp, (daq_mem_size[ch] - rp)*sizeof(uint16_t));
+			daq_map.Decode(ch, p + rp, daq_mem_size[ch] - rp);
+			rp = 0;
+		}
+		alt_dcache_flush_no_writeback(p + rp, (wp - rp)*sizeof(uint16_t));
+		daq_map.Decode(ch, p + rp, wp - rp);
+
+		DAQ_WRITE(daq_base, DAQ_MEM_READ, wp);
+	}
+}
+
+
+// Selects the efficiency bin for the next nTriggers triggers. The events
+// of the previous bin are decoded first: each channel with a data source
+// delivers one event header per trigger. Events missing after
+// DAQ_MAP_TIMEOUT are counted (Daq_MapGetStat), they go into a later bin.
+// A channel without any event so far carries no data (no ROC or TBM
+// connected), it is not waited for again.
+void CTestboard::Daq_MapSetBin(uint16_t bin, uint16_t nTriggers)
+{
+	if (!daq_map_active || daq_map.GetBins() < 2) return;
+
+	uint32_t start = alt_nticks();
+	while (true)
+	{
+		Daq_MapUpdate();
+		uint8_t late = 0;
+		for (uint8_t ch = 0; ch < DAQ_CHANNELS; ch++)
+			if ((daq_map_wait & (1 << ch)) && daq_map.GetEvents(ch) < daq_map_expected[ch])
+				late |= 1 << ch;
+		if (late == 0) break;
+
+		if (alt_nticks() - start >= DAQ_MAP_TIMEOUT)
+		{
+			daq_map_timeouts++;
+			for (uint8_t ch = 0; ch < DAQ_CHANNELS; ch++)
+			{
+				if (!(late & (1 << ch))) continue;
+				daq_map_missing += daq_map_expected[ch] - daq_map.GetEvents(ch);
+				if (daq_map.GetEvents(ch) == 0) daq_map_wait &= ~(1 << ch);
+			}
+			break;
+		}
+	}
+
+	daq_map.SetBin(bin);
+	for (uint8_t ch = 0; ch < DAQ_CHANNELS; ch++)
+		daq_map_expected[ch] = daq_map.GetEvents(ch) + nTriggers;
+}
+
+
+uint32_t CTestboard::Daq_MapGetStat(uint32_t &missing)
+{
+	missing = daq_map_missing;
+	return daq_map_timeouts;
+}
+
+
+// hit counts of all ROCs, sent directly from the map memory
+void CTestboard::Daq_MapGetHits(HWvectorR<uint16_t> &hits)
+{
+	Daq_MapUpdate();
+
+	HWvectorBlock &b = hits.block[0];
+	b.p1 = daq_map.GetHits();
+	b.s1 = daq_map.GetRocs()*PIXMAP_NUMPIXELS;
+	b.p2 = 0;
+	b.s2 = 0;
+	b.base = 0; // nothing to commit
+	b.rp = 0;
+	hits.n = 1;
+}
+
+
+void CTestboard::Daq_MapGetPhSum(uint8_t roc, vectorR<uint32_t> &phsum)
+{
+	Daq_MapUpdate();
+
+	phsum.clear();
+	if (roc >= daq_map.GetRocs()) return;
+	uint32_t *p = daq_map.GetPhSum(roc);
+	phsum.assign(p, p + PIXMAP_NUMPIXELS);
+}
+
+
+// efficiency curves of one ROC: [pixel][bin]
+void CTestboard::Daq_MapGetEff(uint8_t roc, vectorR<uint8_t> &eff)
+{
+	Daq_MapUpdate();
+
+	eff.clear();
+	if (roc >= daq_map.GetRocs() || daq_map.GetBins() < 2) return;
+	uint8_t *p = daq_map.GetEff(roc);
+	eff.assign(p, p + PIXMAP_NUMPIXELS*daq_map.GetBins());
+}
+
+
+// 50% thresholds of one ROC in 1/16 bins
+// (PIXMAP_NO_THRESHOLD = 0xffff if not found)
+void CTestboard::Daq_MapGetThreshold(uint8_t roc, uint8_t nTriggers, vectorR<uint16_t> &threshold)
+{
+	Daq_MapUpdate();
+
+	threshold.clear();
+	uint16_t bins = daq_map.GetBins();
+	if (roc >= daq_map.GetRocs() || bins < 2) return;
+
+	threshold.reserve(PIXMAP_NUMPIXELS);
+	uint8_t *p = daq_map.GetEff(roc);
+	for (uint16_t i = 0; i < PIXMAP_NUMPIXELS; i++, p += bins)
+		threshold.push_back(CPixelMap::Threshold(p, bins, nTriggers));
+}
@@ -0,0 +1,112 @@
+// daq_memory.cc
+
+#include <stdlib.h>
+#include "system.h"
+#include "daq_memory.h"
+
+
+CDaqMemory::CDaqMemory()
+{
+	region = 0;
+	regionSize = 0;
+	for (uint8_t ch = 0; ch < DAQMEM_CHANNELS; ch++) start[ch] = size[ch] = 0;
+}
+
+
+// take the largest block the heap can give, less the firmware reserve
+void CDaqMemory::Init()
+{
+	if (region) return;
+
+	for (uint32_t s = RAM_EXT_SPAN; s > DAQMEM_RESERVE + DAQMEM_STEP; s -= DAQMEM_STEP)
+	{
+		void *p = malloc(s);
+		if (!p) continue;
+		free(p);
+
+		s -= DAQMEM_RESERVE;
+		p = malloc(s + DAQMEM_ALIGN);
+		if (!p) continue;
+		region = (uint8_t*)((((unsigned long)p) + DAQMEM_ALIGN - 1) & ~(DAQMEM_ALIGN - 1));
+		regionSize = s & ~(DAQMEM_ALIGN - 1);
+		return;
+	}
+}
+
+
+// free bytes from pos to the next used block
+uint32_t CDaqMemory::GapAt(uint32_t pos)
+{
+	if (pos >= regionSize) return 0;
+	uint32_t end = regionSize;
+	for (uint8_t ch = 0; ch < DAQMEM_CHANNELS; ch++)
+	{
+		if (size[ch] == 0) continue;
+		if (start[ch] <= pos && pos < start[ch] + size[ch]) return 0;
+		if (start[ch] > pos && start[ch] < end) end = start[ch];
+	}
+	return end - pos;
+}
+
+
+uint16_t* CDaqMemory::Alloc(uint8_t channel, uint32_t &words, uint32_t minwords)
+{
+	if (channel >= DAQMEM_CHANNELS) return 0;
+	Init();
+	Free(channel);
+
+	uint32_t want = (words*2 + DAQMEM_ALIGN - 1) & ~(DAQMEM_ALIGN - 1);
+	uint32_t need = minwords*2;
+
+	// the last place of the channel, else the smallest gap that holds the
+	// block, else the largest gap
+	uint32_t pos = start[channel];
+	uint32_t n = GapAt(pos);
+	if (n < want)
+	{
+		uint32_t bestPos = 0, best = GapAt(0);
+		for (uint8_t ch = 0; ch < DAQMEM_CHANNELS; ch++)
+		{
+			if (size[ch] == 0) continue;
+			uint32_t p = start[ch] + size[ch];
+			uint32_t g = GapAt(p);
+			bool fits = g >= want, bestFits = best >= want;
+			if ((fits && (!bestFits || g < best)) || (!fits && !bestFits && g > best))
+			{
+				bestPos = p;
+				best = g;
+			}
+		}
+		if (best > n) { pos = bestPos; n = best; }
+	}
+	if (n < need) return 0;
+	if (n > want) n = want;
+
+	start[channel] = pos;
+	size[channel] = n;
+	if (words > n/2) words = n/2;
+	return (uint16_t*)(region + pos);
+}
+
+
+void CDaqMemory::Free(uint8_t channel)
+{
+	if (channel < DAQMEM_CHANNELS) size[channel] = 0;
+}
+
+
+uint32_t CDaqMemory::GetFree(uint32_t &largest)
+{
+	Init();
+	uint32_t total = regionSize;
+	largest = GapAt(0);
+	for (uint8_t ch = 0; ch < DAQMEM_CHANNELS; ch++)
+	{
+		if (size[ch] == 0) continue;
+		total -= size[ch];
+		uint32_t g = GapAt(start[ch] + size[ch]);
+		if (g > largest) largest = g;
+	}
+	largest /= 2;
+	return total/2;
+}
@@ -0,0 +1,50 @@
+// daq_memory.h
+// DAQ buffer memory: one region of the SDRAM is taken from the heap at the
+// first use and divided among the DAQ channels. A channel reopened with a
+// size that fits at its last place keeps that place, so open/close cycles
+// never fragment the heap of the firmware.
+
+#pragma once
+
+#include "cstdint.h"
+#include "pixel_map.h"
+
+
+#define DAQMEM_CHANNELS 8
+#define DAQMEM_ALIGN    32          // bytes, DMA bursts and cache lines
+#define DAQMEM_STEP     (1 << 20)   // region size search step
+
+// largest heap copy made by one command (vector Daq_Read, bytes)
+#define DAQMEM_COPY_MAX (4 << 20)
+
+// Bytes left for heap and stack, from the largest users that can exist at
+// the same time: the pixel map of Daq_MapStart (16 ROCs, 256 bins: 17 MB),
+// the firmware upgrade image (2 MB), one command copy (DAQMEM_COPY_MAX,
+// received RPC vectors are at most RPC_RECV_MAX) and 2 MB for the rest.
+#define DAQMEM_RESERVE  (PIXMAP_MAXROCS*PIXMAP_NUMPIXELS*(2 + 4 + PIXMAP_MAXBINS) \
+	+ (2 << 20) + DAQMEM_COPY_MAX + (2 << 20))
+
+
+class CDaqMemory
+{
+	uint8_t *region;
+	uint32_t regionSize;  // bytes
+
+	// block of each channel (byte offset, size 0 = free), start is kept
+	// after Free for the next Alloc
+	uint32_t start[DAQMEM_CHANNELS];
+	uint32_t size[DAQMEM_CHANNELS];
+
+	void Init();
+	uint32_t GapAt(uint32_t pos);
+public:
+	CDaqMemory();
+
+	// allocates at most words (16 bit), returns 0 if less than minwords fit
+	uint16_t* Alloc(uint8_t channel, uint32_t &words, uint32_t minwords);
+	void Free(uint8_t channel);
+
+	// free words in total and in the largest block
+	uint32_t GetFree(uint32_t &largest);
+	uint32_t GetSize() { Init(); return regionSize/2; }
+};
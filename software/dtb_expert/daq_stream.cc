@@ -0,0 +1,154 @@
+// daq_stream.cc
+// DAQ streaming mode: the DAQ ring buffers are pushed to the host
+// without request. Flow control by credits (one credit per segment).
+//
+// On USB a service call starts at most one segment: its header in a
+// staging buffer and one borrowed block of at most SGDMA_MAX_TRANSFER
+// bytes, up to the end of the ring buffer. The chain then fits beside
+// the previous one in the descriptor ring and the transfer starts
+// without waiting. On Ethernet the frames are sent by Write.
+//
+// stream message:
+//   uint32_t header  = (size << 8) + RPC_TYPE_DTB_STREAM
+//   uint32_t segment = channel + (status << 8) + (sequence << 16)
+//   uint16_t data[(size - 4)/2]
+
+#include "pixel_dtb.h"
+#include "sys/alt_alarm.h"
+
+
+// send a partial segment if data is older than this (system ticks)
+#define DAQ_STREAM_LATENCY 2
+
+// segment size limit (words), one DMA descriptor
+#define DAQ_STREAM_SEGMENT_MAX ((SGDMA_MAX_TRANSFER - 8)/2)
+
+
+bool CTestboard::Daq_StreamStart(uint8_t channelmask, uint32_t segmentsize, uint16_t credits)
+{
+	uint32_t bytes, time_ms;
+	Daq_StreamStop(bytes, time_ms);
+
+	// all channels must be open
+	for (uint8_t ch = 0; ch < DAQ_CHANNELS; ch++)
+		if ((channelmask & (1 << ch)) && daq_mem_base[ch] == 0) return false;
+
+	if (segmentsize > DAQ_STREAM_SEGMENT_MAX) segmentsize = DAQ_STREAM_SEGMENT_MAX;
+	if (segmentsize < 256) segmentsize = 256;
+
+	daq_stream_segment = segmentsize;
+	daq_stream_credits = credits;
+	daq_stream_next = 0;
+	daq_stream_count = 0;
+	daq_stream_bytes = 0;
+	daq_stream_start = alt_nticks();
+	for (uint8_t ch = 0; ch < DAQ_CHANNELS; ch++) daq_stream_time[ch] = daq_stream_start;
+	daq_stream_mask = channelmask;
+	return true;
+}
+
+
+void CTestboard::Daq_StreamCredit(uint16_t credits)
+{
+	daq_stream_credits += credits;
+}
+
+
+uint32_t CTestboard::Daq_StreamStop(uint32_t &bytes, uint32_t &time_ms)
+{
+	// commit segments still on the wire
+	while (daq_stream_pending && rpc_io->TxBusy());
+	for (uint8_t ch = 0; ch < DAQ_CHANNELS; ch++)
+		if (daq_stream_pending & (1 << ch))
+			DAQ_WRITE(DAQ_DMA_BASE[ch], DAQ_MEM_READ, daq_stream_rp[ch]);
+	daq_stream_pending = 0;
+
+	if (daq_stream_mask)
+	{
+		daq_stream_mask = 0;
+		bytes = daq_stream_bytes;
+		time_ms = (alt_nticks() - daq_stream_start)*1000/alt_ticks_per_second();
+		return daq_stream_count;
+	}
+	bytes = time_ms = 0;
+	return 0;
+}
+
+
+// Called before a channel is closed, its memory may be released afterwards.
+void CTestboard::Daq_StreamRemove(uint8_t channel)
+{
+	uint8_t bit = 1 << channel;
+	if (daq_stream_pending & bit) while (rpc_io->TxBusy());
+	daq_stream_pending &= ~bit;
+	daq_stream_mask &= ~bit;
+}
+
+
+// Called by the dispatcher while no command is pending.
+// Returns false if streaming is off.
+bool CTestboard::Daq_StreamService()
+{
+	if (daq_stream_mask == 0) return false;
+
+	// commit read pointers after the last segments have been sent
+	if (daq_stream_pending)
+	{
+		if (rpc_io->TxBusy()) return true;
+		for (uint8_t ch = 0; ch < DAQ_CHANNELS; ch++)
+			if (daq_stream_pending & (1 << ch))
+				DAQ_WRITE(DAQ_DMA_BASE[ch], DAQ_MEM_READ, daq_stream_rp[ch]);
+		daq_stream_pending = 0;
+	}
+
+	uint32_t now = alt_nticks();
+	for (uint8_t i = 0; i < DAQ_CHANNELS && daq_stream_credits && !daq_stream_pending; i++)
+	{
+		uint8_t ch = (daq_stream_next + i) & (DAQ_CHANNELS - 1);
+		if (!(daq_stream_mask & (1 << ch))) continue;
+
+		// read dma status (DAQ_THRES is internal, not sent to the host)
+		unsigned int daq_base = DAQ_DMA_BASE[ch];
+		int32_t status = (DAQ_READ(daq_base, DAQ_CONTROL) ^ 1) & ~DAQ_THRES;
+		int32_t rp = DAQ_READ(daq_base, DAQ_MEM_READ);
+		int32_t wp = DAQ_READ(daq_base, DAQ_MEM_WRITE);
+
+		// correct write pointer overrun at memory overflow
+		if (status & DAQ_MEM_OVFL) if (--wp < 0) wp += daq_mem_size[ch];
+
+		// calculate available words in memory
+		int32_t size = wp - rp;
+		if (size < 0) size += daq_mem_size[ch];
+		if (size == 0) { daq_stream_time[ch] = now; continue; }
+
+		// wait for a full segment unless data is getting old
+		if (size < int32_t(daq_stream_segment))
+		{
+			if (now - daq_stream_time[ch] < DAQ_STREAM_LATENCY) continue;
+		}
+		else size = daq_stream_segment;
+
+		// send data block up to the end of the ring buffer, the rest
+		// follows in the next segment
+		if (size > int32_t(daq_mem_size[ch]) - rp) size = daq_mem_size[ch] - rp;
+
+		daq_stream_hdr[ch][0] = ((4 + size*2) << 8) + RPC_TYPE_DTB_STREAM;
+		daq_stream_hdr[ch][1] = ch + ((status & 0xff) << 8) + (daq_stream_count << 16);
+		rpc_io->Write(daq_stream_hdr[ch], 2*sizeof(uint32_t));
+		rpc_io->Write(daq_mem_base[ch] + rp, size*sizeof(uint16_t));
+		rp += size;
+		if (rp >= int32_t(daq_mem_size[ch])) rp = 0;
+
+		// read pointer is committed when transfer has finished
+		daq_stream_rp[ch] = rp;
+		daq_stream_pending |= 1 << ch;
+		daq_stream_time[ch] = now;
+		daq_stream_credits--;
+		daq_stream_count++;
+		daq_stream_bytes += size*2;
+	}
+	daq_stream_next = (daq_stream_next + 1) & (DAQ_CHANNELS - 1);
+
+	if (daq_stream_pending) rpc_io->FlushAsync();
+	return true;
+}
@@ -36,9 +36,9 @@ unsigned long long DTB_CONFIG::GetULL(char *s, int base)
 
 char* DTB_CONFIG::GetString(char *s)
 {
-	char *str1 = strchr(s, '"'); if (str1 == 0) return "";
+	char *str1 = strchr(s, '"'); if (str1 == 0) return s + strlen(s); // ""
 	str1++;
-	char *str2 = strchr(str1, '"'); if (str2 == 0) return "";
+	char *str2 = strchr(str1, '"'); if (str2 == 0) return str1 + strlen(str1);
 	*str2 = 0;
 	return str1;
 }
@@ -6,6 +6,9 @@
 #include "system.h"
 #include "altera_avalon_pio_regs.h"
 #include "alt_types.h"
+#include "sys/alt_alarm.h"
+#include "sys/alt_irq.h"
+#include "altera_avalon_timer_regs.h"
 #include "dtb_hal.h"
 
 
@@ -125,9 +128,83 @@ void Adv3224Init()
 }
 
 
+// === time =================================================================
+
+#define SYS_TIMER_CLOCKS_PER_US (SYS_TIMER_FREQ/1000000)
+
+// system ticks and sys_timer clocks since the last tick
+static inline uint32_t Time_Snapshot(uint32_t &ticks)
+{
+	alt_irq_context cpu_sr = alt_irq_disable_all();
+	IOWR_ALTERA_AVALON_TIMER_SNAPL(SYS_TIMER_BASE, 0);
+	uint32_t count = (IORD_ALTERA_AVALON_TIMER_SNAPH(SYS_TIMER_BASE) << 16)
+		| IORD_ALTERA_AVALON_TIMER_SNAPL(SYS_TIMER_BASE);
+	ticks = alt_nticks();
+
+	// counter reloaded but tick not yet processed
+	if ((IORD_ALTERA_AVALON_TIMER_STATUS(SYS_TIMER_BASE) & ALTERA_AVALON_TIMER_STATUS_TO_MSK)
+		&& count > SYS_TIMER_LOAD_VALUE/2) ticks++;
+	alt_irq_enable_all(cpu_sr);
+
+	return SYS_TIMER_LOAD_VALUE - count;
+}
+
+uint32_t Time_us()
+{
+	uint32_t ticks;
+	uint32_t clk = Time_Snapshot(ticks);
+	return ticks*(SYS_TIMER_PERIOD*1000) // period in ms
+		+ clk/SYS_TIMER_CLOCKS_PER_US;
+}
+
+uint32_t Time_clk()
+{
+	uint32_t ticks;
+	uint32_t clk = Time_Snapshot(ticks);
+	return ticks*(SYS_TIMER_LOAD_VALUE + 1) + clk;
+}
+
+// sys_timer counter alone, counts down from SYS_TIMER_LOAD_VALUE.
+// No interrupt handler takes snapshots, the registers need no lock.
+static inline uint32_t Time_Count()
+{
+	IOWR_ALTERA_AVALON_TIMER_SNAPL(SYS_TIMER_BASE, 0);
+	return (IORD_ALTERA_AVALON_TIMER_SNAPH(SYS_TIMER_BASE) << 16)
+		| IORD_ALTERA_AVALON_TIMER_SNAPL(SYS_TIMER_BASE);
+}
+
+// Delays shorter than half a tick period poll the counter alone (one
+// write and two reads per pass, at most one reload between two passes),
+// longer delays poll Time_clk (interrupts off, tick count, reload check).
+void Wait_clk(uint32_t clocks)
+{
+	if (clocks < SYS_TIMER_LOAD_VALUE/2)
+	{
+		uint32_t last = Time_Count(), elapsed = 0;
+		while (elapsed < clocks)
+		{
+			uint32_t count = Time_Count();
+			elapsed += (count <= last) ? last - count : last + SYS_TIMER_LOAD_VALUE + 1 - count;
+			last = count;
+		}
+		return;
+	}
+
+	uint32_t start = Time_clk();
+	while (Time_clk() - start < clocks);
+}
+
+
 // === USB ==================================================================
 
 
+// Read gives up if the RX FIFO stays empty for USB_RX_TIMEOUT system ticks.
+// The deadline is restarted after each burst, so long uploads never time out
+// while data is still arriving.
+#define USB_RX_TIMEOUT (alt_ticks_per_second()/2)
+
+// read path of the old firmware: one timeout loop per byte, kept as the
+// reference of the upload benchmark (Bench_UsbBytewise)
 bool CUSB::ReadByte(unsigned char &value)
 {
 	unsigned int timeout = 500000;
@@ -144,9 +221,26 @@ bool CUSB::ReadByte(unsigned char &value)
 
 bool CUSB::Read(void *buffer, unsigned int size)
 {
-	unsigned int i;
 	unsigned char *p = (unsigned char*)buffer;
-	for (i=0; i<size; i++) if (!ReadByte(*(p++))) return false;
+	unsigned char *end = p + size;
+
+	if (bytewise)
+	{
+		while (p < end) if (!ReadByte(*(p++))) return false;
+		return true;
+	}
+	alt_u32 deadline = alt_nticks() + USB_RX_TIMEOUT;
+
+	while (p < end)
+	{
+		if (RxFull())
+		{ // drain FIFO burst directly into caller's buffer
+			do *(p++) = IORD_8DIRECT(USB2_BASE, 0);
+			while (p < end && RxFull());
+			deadline = alt_nticks() + USB_RX_TIMEOUT;
+		}
+		else if (alt_32(alt_nticks() - deadline) >= 0) return false;
+	}
 	return true;
 }
 
@@ -165,8 +259,7 @@ bool CUSB::Write(const void *buffer, uint32_t size)
 
 
 void CUSB::Flush()
-{
+{ // send immediate is issued by the DMA completion handler
 	dma.Send();
-	IOWR_8DIRECT(USB2_BASE, 1, 1); // FT232 send immediate
 }
 
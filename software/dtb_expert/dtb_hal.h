@@ -126,11 +126,13 @@ extern const unsigned int DAQ_DMA_BASE[8];
 #define DAQ_MEM_WRITE 12
 #define DAQ_CONTROL   16
 #define DAQ_STATUS    16
+#define DAQ_MEM_THRES 20  // fill level threshold (0 = off)
 
 // -- status bits bitmask
 #define DAQ_RUNNING   1
 #define DAQ_MEM_OVFL  2
 #define DAQ_FIFO_OVFL 4
+#define DAQ_THRES     8  // fill level >= DAQ_MEM_THRES (firmware only, masked for the host)
 
 inline void DAQ_WRITE(unsigned int daq_base, short reg, unsigned long value)
 {IOWR_32DIRECT(daq_base, reg, value); }
@@ -153,6 +155,24 @@ inline unsigned int GetI2cHs(unsigned char reg)
 { return IORD_32DIRECT(PSI2C_BASE, reg<<2); }
 
 
+// === time ==============================================================
+
+// microseconds since start (system tick + sys_timer counter snapshot),
+// wraps after 71 minutes: use only differences
+uint32_t Time_us();
+
+// sys_timer clocks (TIME_CLK_MHZ) since start, wraps after 57 s
+#define TIME_CLK_MHZ (SYS_TIMER_FREQ/1000000)
+uint32_t Time_clk();
+
+// Busy wait on the sys_timer. The counter has 1/TIME_CLK_MHZ us steps,
+// the delay ends at the first polling pass after the given clocks. A pass
+// of the short delay loop is about 20 CPU cycles (one IOWR and two IORD
+// of the timer, instruction count estimate): about 270 ns or 11 ROC
+// clocks at 40 MHz, not one ROC clock. GetMinTriggerSpacing measures it.
+void Wait_clk(uint32_t clocks);
+
+
 // === I2C master ========================================================
 
 // I2C master register
@@ -198,15 +218,22 @@ uint8_t I2C_EEPROM_Read(uint8_t *data, uint8_t length);
 class CUSB : public CRpcIo
 {
 	CDma dma;
-	bool ReadByte(unsigned char &value);
+	bool bytewise; // byte by byte read of the old firmware (benchmark)
 //	void WriteByte(unsigned char value);
+	bool ReadByte(unsigned char &value);
+	static void SendImmediate(void *context)
+	{ IOWR_8DIRECT(USB2_BASE, 1, 1); } // FT232 send immediate
 public:
-	CUSB() {}
+	CUSB() : bytewise(false) { dma.SetHandler(SendImmediate, this); }
+	void SetBytewiseRead(bool on) { bytewise = on; }
 	~CUSB() {}
 	void Reset();
-	bool RxFull() { return IORD_8DIRECT(USB2_BASE, 1) && 0x01; }
+	bool RxFull() { return IORD_8DIRECT(USB2_BASE, 1) & 0x01; }
 	bool Write(const void *buffer, uint32_t size);
 	void Flush();
+	void FlushAsync() { dma.SendAsync(); }
+	bool TxBusy() { return dma.Busy(); }
+	void Commit() { dma.Commit(); }
 	bool Read(void *buffer, unsigned int size);
 };
 
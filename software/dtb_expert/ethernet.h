@@ -1,9 +1,74 @@
 // ethernet.h
+// RPC interface over raw Ethernet frames of the Triple-Speed Ethernet MAC.
+//
+// Frame: destination, source, EtherType ETH_RPC_TYPE, then a 4 byte
+// header (RPC data size, sequence number, both little endian) and the
+// RPC byte stream as on USB. The board answers to the source address of
+// the last received frame.
+//
+// The host sets ETH_RPC_START in the size of a frame that begins with an
+// RPC message. After a gap in the received sequence numbers the message
+// in progress fails (rpc_error, no reply) and frames are dropped up to
+// the next ETH_RPC_START frame; the host repeats the command after its
+// reply timeout.
 
 #pragma once
 
-int eth_init();
+#include "cstdint.h"
+#include "rpc_io.h"
 
-void eth_write(const char* data);
-void eth_flush();
-char* eth_read();
+
+#define ETH_RPC_TYPE   0x88B5  // IEEE 802 local experimental EtherType
+#define ETH_ADDR_SIZE  6
+#define ETH_HEAD_SIZE  18      // MAC header + RPC frame header
+#define ETH_DATA_SIZE  1496    // RPC data per frame (MTU 1500)
+#define ETH_FRAME_SIZE (ETH_HEAD_SIZE + ETH_DATA_SIZE)
+#define ETH_MIN_FRAME  60      // without FCS, shorter frames are padded
+#define ETH_RPC_START  0x8000  // size flag: frame begins with an RPC message
+
+
+// MAC driver (tse_mac.cc, replaced by the simulator in the host build)
+bool tse_Init(const uint8_t *mac);
+// sends one frame from two buffers, returns after the transfer
+bool tse_Send(const void *head, uint16_t head_size, const void *data, uint16_t data_size);
+// copies a received frame, returns its size or 0 if none is pending
+uint16_t tse_Recv(void *frame);
+
+
+class CEthernet : public CRpcIo
+{
+	bool up;
+	uint8_t mac[ETH_ADDR_SIZE];
+	uint8_t host[ETH_ADDR_SIZE];
+
+	// frame received, data from rxPos to rxEnd not yet read
+	uint8_t rxFrame[ETH_FRAME_SIZE];
+	uint16_t rxPos, rxEnd;
+	uint16_t rxSeq;
+	bool rxSync;  // stream at a known position, no frames lost since
+	bool rxGap;   // frames lost, the message being read is broken
+
+	// frame under construction
+	uint8_t txFrame[ETH_FRAME_SIZE];
+	uint16_t txFill;
+	uint16_t txSeq;
+
+	bool Receive();
+	void SetHead(uint8_t *head, uint16_t size);
+	void Send();
+public:
+	uint32_t rxFrames;
+	uint32_t rxLost;    // sequence gaps
+	uint32_t txFrames;
+
+	CEthernet() : up(false), rxPos(0), rxEnd(0), rxSeq(0), rxSync(true), rxGap(false),
+		txFill(0), txSeq(0), rxFrames(0), rxLost(0), txFrames(0) {}
+	bool Init(uint64_t mac_address);
+	bool IsUp() { return up; }
+	void Reset();
+	bool RxFull() { return rxPos < rxEnd || Receive(); }
+	bool Write(const void *buffer, unsigned int size);
+	void Flush();
+	void Commit() {} // data is copied or sent by Write
+	bool Read(void *buffer, unsigned int size);
+};
@@ -3,30 +3,203 @@
 #include "system.h"
 #include "io.h"
 
+#include <string.h>
 #include <sys/alt_irq.h>
+#include <sys/alt_alarm.h>
 #include <sys/alt_cache.h>
 
 #include "pixel_dtb.h"
+#include "dtb_config.h"
 
 
+// === CEthernet ============================================================
 
+// Read gives up if no frame arrives for ETH_RX_TIMEOUT system ticks
+#define ETH_RX_TIMEOUT (alt_ticks_per_second()/2)
 
-bool CTestboard::Ethernet_Init()
+static const uint8_t eth_broadcast[ETH_ADDR_SIZE] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+
+bool CEthernet::Init(uint64_t mac_address)
+{
+	for (int i = 0; i < ETH_ADDR_SIZE; i++) mac[i] = uint8_t(mac_address >> (40 - 8*i));
+	memcpy(host, eth_broadcast, ETH_ADDR_SIZE); // until the first frame is received
+	up = mac_address != 0 && tse_Init(mac);
+	return up;
+}
+
+
+// take the next RPC frame of the MAC, other frames are dropped
+// (and after a sequence gap all up to the next message start)
+bool CEthernet::Receive()
 {
+	if (!up) return false;
+	uint16_t size = tse_Recv(rxFrame);
+	if (size < ETH_HEAD_SIZE) return false;
+
+	if (((rxFrame[12] << 8) | rxFrame[13]) != ETH_RPC_TYPE) return false;
+	if (memcmp(rxFrame, mac, ETH_ADDR_SIZE) != 0
+		&& memcmp(rxFrame, eth_broadcast, ETH_ADDR_SIZE) != 0) return false;
+	uint16_t n   = rxFrame[14] | (rxFrame[15] << 8);
+	uint16_t seq = rxFrame[16] | (rxFrame[17] << 8);
+	bool start = n & ETH_RPC_START;
+	n &= ~ETH_RPC_START;
+	if (n > size - ETH_HEAD_SIZE) return false;
+
+	if (rxFrames && seq != rxSeq)
+	{
+		rxLost++;
+		rxGap = true;
+		rxSync = false;
+	}
+	rxSeq = seq + 1;
+	rxFrames++;
+	memcpy(host, rxFrame + ETH_ADDR_SIZE, ETH_ADDR_SIZE);
+
+	if (!rxSync && !start) return false;
+	rxSync = true;
+
+	rxPos = ETH_HEAD_SIZE;
+	rxEnd = ETH_HEAD_SIZE + n;
+	return n != 0;
+}
+
+
+bool CEthernet::Read(void *buffer, unsigned int size)
+{
+	uint8_t *p = (uint8_t*)buffer;
+	alt_u32 deadline = alt_nticks() + ETH_RX_TIMEOUT;
+
+	while (size)
+	{
+		bool full = RxFull();
+		if (rxGap)
+		{ // a frame of this message is lost, the data of the
+		  // new frame (if any) starts the next message
+			rxGap = false;
+			return false;
+		}
+		if (full)
+		{
+			uint16_t n = rxEnd - rxPos;
+			if (n > size) n = size;
+			memcpy(p, rxFrame + rxPos, n);
+			rxPos += n;
+			p += n;
+			size -= n;
+			deadline = alt_nticks() + ETH_RX_TIMEOUT;
+		}
+		else if (alt_32(alt_nticks() - deadline) >= 0) return false;
+	}
 	return true;
 }
 
 
+void CEthernet::SetHead(uint8_t *head, uint16_t size)
+{
+	memcpy(head, host, ETH_ADDR_SIZE);
+	memcpy(head + ETH_ADDR_SIZE, mac, ETH_ADDR_SIZE);
+	head[12] = uint8_t(ETH_RPC_TYPE >> 8);
+	head[13] = uint8_t(ETH_RPC_TYPE);
+	head[14] = uint8_t(size);
+	head[15] = uint8_t(size >> 8);
+	head[16] = uint8_t(txSeq);
+	head[17] = uint8_t(txSeq >> 8);
+	txSeq++;
+}
+
+
+void CEthernet::Send()
+{
+	if (txFill == 0) return;
+	SetHead(txFrame, txFill);
+	uint16_t size = ETH_HEAD_SIZE + txFill;
+	while (size < ETH_MIN_FRAME) txFrame[size++] = 0;
+	tse_Send(txFrame, size, 0, 0);
+	txFrames++;
+	txFill = 0;
+}
+
+
+bool CEthernet::Write(const void *buffer, unsigned int size)
+{
+	if (!up) return false;
+	const uint8_t *p = (const uint8_t*)buffer;
+
+	while (size)
+	{
+		if (txFill == 0 && size >= ETH_DATA_SIZE)
+		{ // full frame directly from the caller's buffer
+			uint8_t head[ETH_HEAD_SIZE];
+			SetHead(head, ETH_DATA_SIZE);
+			tse_Send(head, ETH_HEAD_SIZE, p, ETH_DATA_SIZE);
+			txFrames++;
+			p += ETH_DATA_SIZE;
+			size -= ETH_DATA_SIZE;
+			continue;
+		}
+
+		uint16_t n = ETH_DATA_SIZE - txFill;
+		if (n > size) n = size;
+		memcpy(txFrame + ETH_HEAD_SIZE + txFill, p, n);
+		txFill += n;
+		p += n;
+		size -= n;
+		if (txFill == ETH_DATA_SIZE) Send();
+	}
+	return true;
+}
+
+
+void CEthernet::Flush()
+{
+	Send();
+}
+
+
+void CEthernet::Reset()
+{
+	txFill = 0;
+}
+
+
+// === CTestboard ===========================================================
+
+bool CTestboard::Ethernet_Init()
+{
+	return eth.Init(dtbConfig.mac_address);
+}
+
+
 void CTestboard::Ethernet_Send(string &message)
 {
+	if (!eth.IsUp()) return;
+	eth.Write(message.data(), message.length());
+	eth.Flush();
 }
 
 
 uint32_t CTestboard::Ethernet_RecvPackets()
 {
-	return 0;
+	return eth.rxFrames;
 }
 
 
+uint32_t CTestboard::Ethernet_GetStat(uint32_t &lost, uint32_t &sent)
+{
+	lost = eth.rxLost;
+	sent = eth.txFrames;
+	return eth.rxFrames;
+}
 
 
+// commands are served on the interface they arrive on
+CRpcIo* CTestboard::RpcIoSelect()
+{
+	if (!rpc_io->RxFull())
+	{
+		if (usb.RxFull()) rpc_io = &usb;
+		else if (eth.RxFull()) rpc_io = &eth;
+	}
+	return rpc_io;
+}
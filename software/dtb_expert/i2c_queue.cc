@@ -0,0 +1,41 @@
+// i2c_queue.cc
+
+#include "i2c_queue.h"
+#include "dtb_hal.h"
+
+
+// Starts the next commands if psi2c is idle, returns immediately otherwise.
+// A go written during a running transfer would cause a spurious start-stop
+// sequence, so the fifo is only loaded while the interface is idle.
+void CI2cQueue::Drain()
+{
+	if (rd == done) return;
+	if (GetI2cHs(0) & 1) return; // transfer running
+
+	uint16_t n = 0;  // words in psi2c fifo
+	uint8_t go = 0;
+	while (rd != done)
+	{
+		// find end of next command
+		uint16_t e = rd, len = 0;
+		while (queue[e] >> 12) { e = Next(e); len++; }
+
+		// all commands of one transfer must fit and use the same mode
+		uint8_t cmdgo = queue[e];
+		if (n + len > PSI2C_FIFO_SIZE || (go && cmdgo != go)) break;
+
+		for (; rd != e; rd = Next(rd)) SetI2cHs(queue[rd] >> 12, queue[rd] & 0xfff);
+		rd = Next(e);
+		n += len;
+		go = cmdgo;
+	}
+	SetI2cHs(0, go);
+}
+
+
+// Waits until all queued commands have been sent.
+void CI2cQueue::Fence()
+{
+	while (rd != done) Drain();
+	while (GetI2cHs(0) & 1);
+}
@@ -0,0 +1,36 @@
+// i2c_queue.h
+
+#pragma once
+
+#include "cstdint.h"
+
+
+// Command queue in front of the psi2c (ROC/TBM I2C) interface.
+//
+// A command is a sequence of psi2c register writes (Put) closed by the
+// go value (Go). Commands are copied into the 256 word psi2c fifo while
+// the interface is idle; all commands that fit are started with a single
+// go and sent by the hardware as one stream. The CPU only waits if the
+// queue is full or at a Fence().
+
+#define I2C_QUEUE_SIZE 2048  // power of 2
+#define PSI2C_FIFO_SIZE 256
+
+class CI2cQueue
+{
+	// entry = (register << 12) + value, register 0 = go (end of command)
+	uint16_t queue[I2C_QUEUE_SIZE];
+	uint16_t rd;    // next entry to send
+	uint16_t done;  // end of last complete command
+	uint16_t wr;    // next free entry
+
+	static uint16_t Next(uint16_t i) { return (i + 1) & (I2C_QUEUE_SIZE - 1); }
+	void Write(uint16_t x) { while (Next(wr) == rd) Drain(); queue[wr] = x; wr = Next(wr); }
+public:
+	CI2cQueue() : rd(0), done(0), wr(0) {}
+	void Put(uint8_t reg, uint16_t value) { Write((reg << 12) + (value & 0xfff)); }
+	void Go(uint8_t go) { Write(go); done = wr; Drain(); }
+	void Drain();
+	void Fence();
+	bool Empty() { return rd == done; }
+};
@@ -6,6 +6,7 @@
 #include "rpc.h"
 #include "SRecordReader.h"
 #include "sys/alt_cache.h"
+#include <string.h>
 
 
 const int delayAdjust = 4;
@@ -51,6 +52,12 @@ bool CTestboard::GetRpcCallName(int32_t id, stringR &callName)
 }
 
 
+void CTestboard::GetRpcCallNames(stringR &names)
+{
+	rpc_GetRpcCallNames(names);
+}
+
+
 uint32_t CTestboard::GetRpcCallHash()
 {
 	uint32_t hash = 0;
@@ -61,6 +68,56 @@ uint32_t CTestboard::GetRpcCallHash()
 	return hash;
 }
 
+void CTestboard::RpcBatchBegin()
+{
+	rpc_batch.Begin();
+}
+
+
+uint16_t CTestboard::RpcBatchEnd()
+{
+	return rpc_batch.End();
+}
+
+
+uint32_t CTestboard::RpcProfileGet(vectorR<uint32_t> &profile)
+{
+	profile.clear();
+	profile.reserve(rpc_cmdListSize*7);
+	for (uint16_t i = 0; i<rpc_cmdListSize; i++)
+	{
+		CRpcProfileEntry &e = rpc_profile.cmd[i];
+		profile.push_back(e.count);
+		profile.push_back(uint32_t(e.clk));
+		profile.push_back(uint32_t(e.clk >> 32));
+		profile.push_back(e.count ? e.min : 0);
+		profile.push_back(e.max);
+		profile.push_back(uint32_t(e.flush));
+		profile.push_back(uint32_t(e.flush >> 32));
+	}
+	return SYS_TIMER_FREQ;
+}
+
+
+void CTestboard::RpcProfileReset()
+{
+	rpc_profile.Reset();
+}
+
+
+void CTestboard::GetRpcAllocStat(vectorR<uint32_t> &stat, bool reset)
+{
+	stat.clear();
+	stat.push_back(rpc_arena.allocs);
+	stat.push_back(rpc_arena.overflows);
+	stat.push_back(rpc_arena.peak);
+	stat.push_back(rpc_arena.heapAllocs);
+	stat.push_back(rpc_arena.heapFrees);
+	stat.push_back(rpc_arena.sinkBytes);
+	if (reset) rpc_arena.ResetStat();
+}
+
+
 uint32_t CTestboard::GetHashForString(const char * s)
 {
 	uint32_t h = 31;
@@ -210,7 +267,13 @@ CTestboard::CTestboard()
 	{
 		daq_mem_base[i] = 0;
 		daq_mem_size[i] = 0;
+		daq_watermark[i] = 0;
 	}
+	daq_watermark_hw = 0;
+	daq_stream_mask = 0;
+	daq_stream_pending = 0;
+	daq_map_active = false;
+	chipMaskTime = 0;
 
 	// stop all DMA channels
 	DAQ_WRITE(DAQ_DMA_0_BASE, DAQ_CONTROL, 0);
@@ -260,6 +323,9 @@ void CTestboard::Init()
 	Deser400_PdRate(1);
 
 	ChipId  = 0;
+	rocId = 0;
+	rocWritten = rocSkipped = rocInvalidated = 0;
+	roc_ShadowInvalidate();
 	TBM_present = false;
 	MOD_present = false;
 	HUB_address = 0;
@@ -328,7 +394,10 @@ void CTestboard::Init()
 	// -- default Test Loop parameter settings
 	SetLoopTriggerDelay(0);
 	SetLoopTrimDelay(0);
+	SetLoopTriggerMode(LOOP_TRIGGER_FIXED);
 	LoopInterruptReset(); // Reset loop interrupt to none.
+	LoopPreambleTime = LoopResumeCount = LoopResumeSaved = 0;
+	scan.valid = false;
 	// -- default ROC_I2C_ADDRESSES for a module: 0-15
 	for(int i = 0; i < 16; i++) {
 	  ROC_I2C_ADDRESSES[i] = i;
@@ -339,20 +408,45 @@ void CTestboard::Init()
 
 // === timing ===============================================================
 
+// ROC clocks at the current clock divider (1.25 MHz while power is off)
+// in sys_timer clocks. 40 MHz clock = 15/8 sys_timer clocks (75 MHz).
+uint32_t CTestboard::TimerClocks(uint32_t clocks)
+{
+	uint8_t div = isPowerOn ? (currentClock & 7) : MHZ_1_25;
+	return ((clocks*15) << div)/8;
+}
+
 void CTestboard::cDelay(uint16_t clocks)
 {
-	uint16_t us = clocks / 40;
-	if (us == 0) us = 1;
-	uDelay(us);
+	i2c.Fence();
+	Wait_clk(TimerClocks(clocks));
 }
 
 void CTestboard::uDelay(uint16_t us)
 {
-	usleep(us);
+	i2c.Fence();
+	Wait_clk(uint32_t(us)*TIME_CLK_MHZ);
+}
+
+// Shortest trigger spacing in ns: cDelay(1) + Pg_Single overhead,
+// measured without sending triggers. This is the granularity of cDelay,
+// one polling pass of Wait_clk and the call, rather than one ROC clock.
+uint16_t CTestboard::GetMinTriggerSpacing()
+{
+	const uint16_t n = 64;
+	uint32_t start = Time_clk();
+	for (uint16_t i = 0; i < n; i++)
+	{
+		cDelay(1);
+		i2c.Fence(); // as in Pg_Single
+	}
+	uint32_t ns = (Time_clk() - start)*1000/(n*TIME_CLK_MHZ);
+	return ns < 0xffff ? ns : 0xffff;
 }
 
 void CTestboard::mDelay(uint16_t ms)
 {
+	i2c.Fence();
 	uint16_t i;
 	for (i=0; i<ms; i++) usleep(1000);
 }
@@ -633,6 +727,7 @@ void CTestboard::Pon()
 {
 	SetClock_(currentClock);
 	if (isPowerOn) return;
+	roc_ShadowInvalidate(); // ROC registers undefined after power up
 
 	SetDac(0, 184);	// va = 1V;
 	SetDac(2, 184);	// vd = 1V;
@@ -660,6 +755,7 @@ void CTestboard::Poff()
 	mainCtrl &= ~(MAINCTRL_PWR_ON | MAINCTRL_ADCENA);
 	_MainControl(mainCtrl);
 	isPowerOn = false;
+	roc_ShadowInvalidate();
 
 	Daq_Close(0);
 	Daq_Close(1);
@@ -876,6 +972,7 @@ void CTestboard::HVoff()
 
 void CTestboard::ResetOn()
 {
+	roc_ShadowInvalidate();
 	mainCtrl |= MAINCTRL_DUT_nRES;
 	_MainControl(mainCtrl);
 }
@@ -1039,6 +1136,7 @@ void CTestboard::Pg_Stop()
 
 void CTestboard::Pg_Single()
 {
+	i2c.Fence();
 	IOWR_32DIRECT(PATTERNGEN_CTRL_BASE, 0, 0x00);
 	IOWR_32DIRECT(PATTERNGEN_CTRL_BASE, 0, 0x81);
 }
@@ -1046,6 +1144,7 @@ void CTestboard::Pg_Single()
 
 void CTestboard::Pg_Trigger()
 {
+	i2c.Fence();
 	IOWR_32DIRECT(PATTERNGEN_CTRL_BASE, 0, 0x00);
 	IOWR_32DIRECT(PATTERNGEN_CTRL_BASE, 0, 0x82);
 }
@@ -1060,6 +1159,7 @@ void CTestboard::Pg_Triggers(uint32_t triggers, uint16_t period)
 
 void CTestboard::Pg_Loop(unsigned short period)
 {
+	i2c.Fence();
 	IOWR_32DIRECT(PATTERNGEN_CTRL_BASE, 0, 0x00);
 	IOWR_32DIRECT(PATTERNGEN_CTRL_BASE, 4, period);
 	IOWR_32DIRECT(PATTERNGEN_CTRL_BASE, 0, 0x84);
@@ -1084,6 +1184,7 @@ void CTestboard::roc_I2cAddr(uint8_t id)
 {
 	ChipId = id & 0x0f;
 	ChipId = id << 4;
+	rocId = id & 0x0f;
 	if (layer_1) roc_I2cAddr_Layer_1(id);
 	else
 	{
@@ -1106,27 +1207,69 @@ void CTestboard::roc_I2cAddr_Layer_1(uint8_t id)
 }
 
 
+void CTestboard::SetPixelAddressInverted(bool status)
+{
+	roc_pixeladdress_inverted = status;
+}
+
+
+// -- ROC state shadow
+void CRocShadow::Invalidate()
+{
+	memset(dacKnown, 0, sizeof(dacKnown));
+	memset(pix, ROC_SHADOW_UNKNOWN, sizeof(pix));
+	colKnown = 0;
+	calKnown = false;
+	nCal = 0;
+}
+
+
+void CTestboard::roc_ShadowInvalidate()
+{
+	for (uint8_t i = 0; i < MOD_NUMROCS; i++) roc_shadow[i].Invalidate();
+	rocInvalidated++;
+}
+
+
+uint32_t CTestboard::roc_ShadowStat(uint32_t &skipped)
+{
+	skipped = rocSkipped;
+	return rocWritten;
+}
+
+
 // -- sends "ClrCal" command to ROC
 void CTestboard::roc_ClrCal()
 {
-	while (GetI2cHs(0) & 1);
-	if (TBM_present) SetI2cHs(3, HUB_address);
-	SetI2cHs(5, 0x01 + ChipId);
-	SetI2cHs(1, 0);
-	SetI2cHs(0, TBM_present?3:1);
+	CRocShadow &s = roc_shadow[rocId];
+	if (s.calKnown && s.nCal == 0) { rocSkipped++; return; }
+
+	if (TBM_present) i2c.Put(3, HUB_address);
+	i2c.Put(5, 0x01 + ChipId);
+	i2c.Put(1, 0);
+	i2c.Go(TBM_present?3:1);
+	rocWritten++;
+
+	s.calKnown = true;
+	s.nCal = 0;
 }
 
 
 // -- sets a single (DAC) register
 void CTestboard::roc_SetDAC(uint8_t reg, uint8_t value)
 {
-	while (GetI2cHs(0) & 1);
-	if (TBM_present) SetI2cHs(3, HUB_address);
-	SetI2cHs(3, 0x08 + ChipId);
-	SetI2cHs(2, reg);
-	SetI2cHs(4, value);
-	SetI2cHs(1, 0);
-	SetI2cHs(0, TBM_present?3:1);
+	CRocShadow &s = roc_shadow[rocId];
+	if (s.DacKnown(reg) && s.dac[reg] == value) { rocSkipped++; return; }
+
+	if (TBM_present) i2c.Put(3, HUB_address);
+	i2c.Put(3, 0x08 + ChipId);
+	i2c.Put(2, reg);
+	i2c.Put(4, value);
+	i2c.Put(1, 0);
+	i2c.Go(TBM_present?3:1);
+	rocWritten++;
+
+	s.SetDac(reg, value);
 }
 
 
@@ -1134,82 +1277,88 @@ void CTestboard::roc_SetDAC(uint8_t reg, uint8_t value)
 //    M - - - 8 4 2 1
 void CTestboard::roc_Pix(uint8_t col, uint8_t row, uint8_t value)
 {
-	while (GetI2cHs(0) & 1);
-	if (TBM_present) SetI2cHs(3, HUB_address);
-	SetI2cHs(3, 0x04 + ChipId);
-	SetI2cHs(2, COLCODE(col));
-	SetI2cHs(2, ROWCODE(row));
-	SetI2cHs(4, value & 0x8f);
-	SetI2cHs(1, 0);
-	SetI2cHs(0, TBM_present?3:1);
+	value &= 0x8f;
+	bool inside = col < ROC_NUMCOLS && row < ROC_NUMROWS;
+	uint8_t &pix = roc_shadow[rocId].pix[inside ? col*ROC_NUMROWS + row : 0];
+	if (inside && pix == value) { rocSkipped++; return; }
+
+	if (TBM_present) i2c.Put(3, HUB_address);
+	i2c.Put(3, 0x04 + ChipId);
+	i2c.Put(2, COLCODE(col));
+	i2c.Put(2, ROWCODE(row));
+	i2c.Put(4, value);
+	i2c.Put(1, 0);
+	i2c.Go(TBM_present?3:1);
+	rocWritten++;
+
+	if (inside) pix = value;
 }
 
 
 // -- trimm a single pixel (count < =60)
 void CTestboard::roc_Pix_Trim(uint8_t col, uint8_t row, uint8_t value)
 {
-	while (GetI2cHs(0) & 1);
-	if (TBM_present) SetI2cHs(3, HUB_address);
-	SetI2cHs(3, 0x04 + ChipId);
-	SetI2cHs(2, COLCODE(col));
-	SetI2cHs(2, ROWCODE(row));
-	SetI2cHs(4, (value & 0x0f) | 0x80);
-	SetI2cHs(1, 0);
-	SetI2cHs(0, TBM_present?3:1);
+	roc_Pix(col, row, (value & 0x0f) | 0x80);
 }
 
 
 // -- mask a single pixel (count <= 60)
 void CTestboard::roc_Pix_Mask(uint8_t col, uint8_t row)
 {
-	while (GetI2cHs(0) & 1);
-	if (TBM_present) SetI2cHs(3, HUB_address);
-	SetI2cHs(3, 0x04 + ChipId);
-	SetI2cHs(2, COLCODE(col));
-	SetI2cHs(2, ROWCODE(row));
-	SetI2cHs(4, 0x0f);
-	SetI2cHs(1, 0);
-	SetI2cHs(0, TBM_present?3:1);
+	roc_Pix(col, row, 0x0f);
 }
 
 
 // -- set calibrate at specific column and row
 void CTestboard::roc_Pix_Cal(uint8_t col, uint8_t row, bool sensor_cal)
 {
-	while (GetI2cHs(0) & 1);
-	if (TBM_present) SetI2cHs(3, HUB_address);
-	SetI2cHs(3, 0x02 + ChipId);
-	SetI2cHs(2, COLCODE(col));
-	SetI2cHs(2, ROWCODE(row));
-	SetI2cHs(4, 0x01);
-	SetI2cHs(1, 0);
-	SetI2cHs(0, TBM_present?3:1);
+	CRocShadow &s = roc_shadow[rocId];
+	bool inside = col < ROC_NUMCOLS && row < ROC_NUMROWS;
+	uint16_t key = 2*(col*ROC_NUMROWS + row) + (sensor_cal ? 1 : 0);
 
-	if (sensor_cal)
+	// already set in the same mode since last ClrCal?
+	int16_t entry = -1;
+	if (s.calKnown && inside)
+		for (uint8_t i = 0; i < s.nCal; i++) if ((s.cal[i] >> 1) == (key >> 1)) entry = i;
+	if (entry >= 0 && s.cal[entry] == key) { rocSkipped++; return; }
+
+	// 0x01 sets the cal, 0x02 switches it to sensor cal
+	for (uint8_t k = 0; k < (sensor_cal ? 2 : 1); k++)
 	{
-		while (GetI2cHs(0) & 1);
-		if (TBM_present) SetI2cHs(3, HUB_address);
-		SetI2cHs(3, 0x02 + ChipId);
-		SetI2cHs(2, COLCODE(col));
-		SetI2cHs(2, ROWCODE(row));
-		SetI2cHs(4, 0x02);
-		SetI2cHs(1, 0);
-		SetI2cHs(0, TBM_present?3:1);
+		if (TBM_present) i2c.Put(3, HUB_address);
+		i2c.Put(3, 0x02 + ChipId);
+		i2c.Put(2, COLCODE(col));
+		i2c.Put(2, ROWCODE(row));
+		i2c.Put(4, k ? 0x02 : 0x01);
+		i2c.Put(1, 0);
+		i2c.Go(TBM_present?3:1);
+		rocWritten++;
 	}
+
+	if (entry >= 0) s.cal[entry] = key;
+	else if (inside && s.nCal < ROC_SHADOW_CALS) s.cal[s.nCal++] = key;
+	else s.calKnown = false;
 }
 
 
 // -- enable/disable a double column
 void CTestboard::roc_Col_Enable(uint8_t col, bool on)
 {
-	while (GetI2cHs(0) & 1);
-	if (TBM_present) SetI2cHs(3, HUB_address);
-	SetI2cHs(3, 0x04 + ChipId);
-	SetI2cHs(2, COLCODE(col) & 0xfe);
-	SetI2cHs(2, 0x40);
-	SetI2cHs(4, on ? 0x80 : 0x00);
-	SetI2cHs(1, 0);
-	SetI2cHs(0, TBM_present?3:1);
+	CRocShadow &s = roc_shadow[rocId];
+	uint32_t dc = (col < ROC_NUMCOLS) ? 1 << (col >> 1) : 0;
+	if ((s.colKnown & dc) && ((s.colEnable & dc) != 0) == on) { rocSkipped++; return; }
+
+	if (TBM_present) i2c.Put(3, HUB_address);
+	i2c.Put(3, 0x04 + ChipId);
+	i2c.Put(2, COLCODE(col) & 0xfe);
+	i2c.Put(2, 0x40);
+	i2c.Put(4, on ? 0x80 : 0x00);
+	i2c.Put(1, 0);
+	i2c.Go(TBM_present?3:1);
+	rocWritten++;
+
+	s.colKnown |= dc;
+	if (on) s.colEnable |= dc; else s.colEnable &= ~dc;
 }
 
 void CTestboard::roc_AllCol_Enable(bool on)
@@ -1229,16 +1378,25 @@ void CTestboard::roc_Col_Mask(uint8_t col)
 
 
 // -- mask all pixels and columns of the chip
+//    the commands are paced by the I2C queue only (psi2c fifo batches)
 void CTestboard::roc_Chip_Mask()
 {
 	int row, col;
+	uint32_t t = Time_us();
 
-	for (col=0; col<ROC_NUMCOLS; col+=2)
-	{ roc_Col_Enable(col,false); cDelay(5); }
+	for (col=0; col<ROC_NUMCOLS; col+=2) roc_Col_Enable(col,false);
 
 	for (col=0; col<ROC_NUMCOLS; col++)
-		for (row=0; row<ROC_NUMROWS; row++)
-		{ roc_Pix_Mask(col, row);  cDelay(5); }
+		for (row=0; row<ROC_NUMROWS; row++) roc_Pix_Mask(col, row);
+
+	i2c.Fence();
+	chipMaskTime = Time_us() - t;
+}
+
+
+uint32_t CTestboard::roc_Chip_Mask_Time()
+{
+	return chipMaskTime;
 }
 
 // -- TBM functions --
@@ -1251,6 +1409,7 @@ bool CTestboard::TBM_Present()
 
 void CTestboard::tbm_Enable(bool on)
 {
+        if (on != TBM_present) roc_ShadowInvalidate(); // other ROCs addressed
         TBM_present = on;
         if (!TBM_present) MOD_present = 0;
 }
@@ -1258,25 +1417,32 @@ void CTestboard::tbm_Enable(bool on)
 
 void CTestboard::tbm_Addr(uint8_t hub, uint8_t port)
 {
+        uint8_t addr = ((hub & 0x1f)<<3) + (port & 0x07);
+        if (MOD_present || addr != HUB_address) roc_ShadowInvalidate(); // other ROCs addressed
         MOD_present = false;
-        HUB_address = ((hub & 0x1f)<<3) + (port & 0x07);
+        HUB_address = addr;
 }
 
 
 void CTestboard::mod_Addr(uint8_t hub)
 {
+        uint8_t addr = ((hub & 0x1f)<<3);
+        if (!MOD_present || (HUB_address & 0xf8) != addr) roc_ShadowInvalidate(); // other ROCs addressed
         MOD_present = true;
-        HUB_address = ((hub & 0x1f)<<3);
+        HUB_address = addr;
 }
 
 
 // set both hub addresses and enable layer 1 switch
 void CTestboard::mod_Addr(uint8_t hub0, uint8_t hub1)
 {
+		uint8_t addr0 = ((hub0 & 0x1f)<<3), addr1 = ((hub1 & 0x1f)<<3);
+		if (!layer_1 || !MOD_present || addr0 != HUB_address0 || addr1 != HUB_address1)
+			roc_ShadowInvalidate(); // other ROCs addressed
 		layer_1 = true;
 		MOD_present = true;
-		HUB_address0 = ((hub0 & 0x1f)<<3);
-		HUB_address1 = ((hub1 & 0x1f)<<3);
+		HUB_address0 = addr0;
+		HUB_address1 = addr1;
 }
 
 
@@ -1286,11 +1452,10 @@ void CTestboard::tbm_Set(uint8_t reg, uint8_t value)
 {
         if (!TBM_present) return;
 
-        while (GetI2cHs(0) & 1);
-        SetI2cHs(3, (HUB_address & (0x1f<<3)) + 4); // 4 is the TBM address
-        SetI2cHs(3, reg);
-        SetI2cHs(4, value);
-        SetI2cHs(0, 3);
+        i2c.Put(3, (HUB_address & (0x1f<<3)) + 4); // 4 is the TBM address
+        i2c.Put(3, reg);
+        i2c.Put(4, value);
+        i2c.Go(3);
 }
 
 
@@ -1308,6 +1473,7 @@ bool CTestboard::tbm_GetRaw(uint8_t reg, uint32_t &value)
 {
         if (!TBM_present) { value = 0x00000000; return false; }
 
+        i2c.Fence(); // readback needs exclusive access
         SetI2cHs(3, (HUB_address & (0x1f<<3)) + 4);
         SetI2cHs(3, reg | 1);
         SetI2cHs(4, 0xff);
@@ -1377,7 +1543,7 @@ uint8_t CTestboard::Daq_FillLevel(uint8_t channel) {
 
   if (daq_mem_base[channel] == 0) return 0;
 
-  return (uint8_t)((double)Daq_GetSize(channel)/daq_mem_size[channel]*100);
+  return (uint8_t)(uint64_t(Daq_GetSize(channel))*100/daq_mem_size[channel]);
 }
 
 uint8_t CTestboard::Daq_FillLevel() {
@@ -1387,7 +1553,7 @@ uint8_t CTestboard::Daq_FillLevel() {
   for (uint8_t channel = 0; channel < DAQ_CHANNELS; channel++) {
     if (daq_mem_base[channel] == 0) continue;
 
-    uint8_t level = (uint8_t)((double)Daq_GetSize(channel)/daq_mem_size[channel]*100);
+    uint8_t level = (uint8_t)(uint64_t(Daq_GetSize(channel))*100/daq_mem_size[channel]);
     if(level > maxlevel) maxlevel = level;
   }
 
@@ -1402,11 +1568,10 @@ uint32_t CTestboard::Daq_Open(uint32_t buffersize, uint8_t channel)
 	Daq_Close(channel);
 
 	// set size limits for memory allocation
-	if (buffersize > 50000000) buffersize = 50000000;  // max 50 Mio samples
 	if (buffersize < 8192) buffersize = 8192;  // min 8192 samples
 
-	// allocate memory
-	daq_mem_base[channel] = new uint16_t[buffersize];
+	// allocate memory, at most the largest free block
+	daq_mem_base[channel] = daq_memory.Alloc(channel, buffersize, 8192);
 	if (daq_mem_base[channel] == 0) return 0;
 	daq_mem_size[channel] = buffersize;
 
@@ -1415,6 +1580,15 @@ uint32_t CTestboard::Daq_Open(uint32_t buffersize, uint8_t channel)
 	DAQ_WRITE(daq_base, DAQ_MEM_BASE, (unsigned long)(daq_mem_base[channel]));
 	DAQ_WRITE(daq_base, DAQ_MEM_SIZE, daq_mem_size[channel]);
 
+	// loop interrupt watermark, checked by the DMA if the core has the
+	// threshold register (reads back the status on older cores)
+	daq_watermark[channel] = buffersize/100*LOOP_MAX_FILLLEVEL;
+	DAQ_WRITE(daq_base, DAQ_MEM_THRES, daq_watermark[channel]);
+	if (DAQ_READ(daq_base, DAQ_MEM_THRES) == daq_watermark[channel])
+		daq_watermark_hw |= 1 << channel;
+	else
+		daq_watermark_hw &= ~(1 << channel);
+
 	alt_dcache_flush(daq_mem_base[channel], buffersize*2);
 
 	// enable deser400
@@ -1430,11 +1604,12 @@ void CTestboard::Daq_Close(uint8_t channel)
 
 	if (daq_mem_base[channel])
 	{
+		Daq_StreamRemove(channel);
 		Daq_DeselectAll();
 		Daq_Stop(channel);
 		IOWR_ALTERA_AVALON_PIO_DATA(DESER160_BASE, 0); // FIFO reset
 		uDelay(1);
-		delete[] daq_mem_base[channel];
+		daq_memory.Free(channel);
 		daq_mem_base[channel] = 0;
 	}
 
@@ -1445,6 +1620,11 @@ void CTestboard::Daq_Close(uint8_t channel)
 	LoopInterruptReset();
 }
 
+uint32_t CTestboard::Daq_GetFreeMem(uint32_t &largest)
+{
+	return daq_memory.GetFree(largest);
+}
+
 void CTestboard::Daq_MemReset(uint8_t channel) {
 
   if (channel >= DAQ_CHANNELS) return;
@@ -1521,8 +1701,32 @@ uint32_t CTestboard::Daq_GetSize(uint8_t channel)
 	return fifosize;
 }
 
-template <class T>
-inline T* Uncache(T *x) { return (T*)(((unsigned long)x) | 0x80000000); }
+
+// DESER400 n writes channels 2n and 2n+1, the other sources channel 0
+uint8_t CTestboard::Daq_DataChannels()
+{
+	uint8_t mask = 0;
+	if (daq_select_deser400)
+	{
+		for (uint8_t deser = 0; deser < 4; deser++)
+			if (deser400_ena & (1 << deser)) mask |= 3 << (2*deser);
+	}
+	else if (daq_select_adc || daq_select_deser160 || daq_select_datasim) mask = 1;
+
+	for (uint8_t ch = 0; ch < DAQ_CHANNELS; ch++)
+		if (daq_mem_base[ch] == 0) mask &= ~(1 << ch);
+	return mask;
+}
+
+// Copies DAQ memory with cached reads: the stale cache lines of the block
+// are dropped, then each line is filled by one burst from the SDRAM. The
+// CPU never writes the DAQ buffers (DAQMEM_ALIGN blocks), no data is lost.
+static void Daq_Copy(uint16_t *dst, uint16_t *src, uint32_t size)
+{
+	alt_dcache_flush_no_writeback(src, size*sizeof(uint16_t));
+	memcpy(dst, src, size*sizeof(uint16_t));
+}
+
 
 uint8_t CTestboard::Daq_Read(vectorR<uint16_t> &data,
 		 uint32_t blocksize, uint8_t channel)
@@ -1541,13 +1745,16 @@ uint8_t CTestboard::Daq_Read(vectorR<uint16_t> &data,
 
 	if (daq_mem_base[channel] == 0) { availsize = 0; return 0; }
 
-	// limit maximal block size
-	if (blocksize > 0x800000) blocksize = 0x800000;
+	// a streaming channel is read by Daq_StreamService only
+	if (daq_stream_mask & (1 << channel)) { availsize = 0; return 0; }
+
+	// limit maximal block size (the copy is on the heap)
+	if (blocksize > DAQMEM_COPY_MAX/2) blocksize = DAQMEM_COPY_MAX/2;
 	if (blocksize > daq_mem_size[channel]) blocksize = daq_mem_size[channel];
 
-	// read dma status
+	// read dma status (DAQ_THRES is internal, not sent to the host)
 	unsigned int daq_base = DAQ_DMA_BASE[channel];
-	int32_t status = DAQ_READ(daq_base, DAQ_CONTROL) ^ 1;
+	int32_t status = (DAQ_READ(daq_base, DAQ_CONTROL) ^ 1) & ~DAQ_THRES;
 	int32_t rp = DAQ_READ(daq_base, DAQ_MEM_READ);
 	int32_t wp = DAQ_READ(daq_base, DAQ_MEM_WRITE);
 
@@ -1564,8 +1771,8 @@ uint8_t CTestboard::Daq_Read(vectorR<uint16_t> &data,
 	// return remaining data size
 	availsize = fifosize - blocksize;
 
-	// allocate space in vector or return empty data
-	if (blocksize > 0) data.reserve(blocksize);
+	// size the vector (keeps the capacity of a reused vector) or return empty data
+	if (blocksize > 0) data.resize(blocksize);
 	else return uint8_t(status);
 
 	// --- send 1st part of the data block
@@ -1573,15 +1780,13 @@ uint8_t CTestboard::Daq_Read(vectorR<uint16_t> &data,
 	if (size1 > int32_t(blocksize)) size1 = blocksize;
 
 	// copy data to vector
-	uint16_t *p = Uncache(daq_mem_base[channel]) + rp;
-	data.insert(data.end(), p, p + size1);
+	Daq_Copy(&data[0], daq_mem_base[channel] + rp, size1);
 	blocksize -= size1;
 
 	// --- send 2ns part of the data block
 	if (blocksize > 0)
 	{
-		p = Uncache(daq_mem_base[channel]);
-		data.insert(data.end(), p, p + blocksize);
+		Daq_Copy(&data[size1], daq_mem_base[channel], blocksize);
 		rp = blocksize;
 	}
 	else rp += size1;
@@ -1608,6 +1813,45 @@ uint8_t CTestboard::Daq_Read(HWvectorR<uint16_t> &data,
 
 uint8_t CTestboard::Daq_Read(HWvectorR<uint16_t> &data,
 		uint32_t blocksize, uint32_t &availsize, uint8_t channel)
+{
+	data.n = 1;
+	return Daq_ReadBlock(data.block[0], blocksize, availsize, channel);
+}
+
+
+uint8_t CTestboard::Daq_ReadAll(HWvectorR<uint16_t> &data,
+		uint32_t blocksize, uint8_t channelmask)
+{
+	uint8_t status = 0;
+	uint32_t availsize;
+
+	// words left in the data message after the block headers
+	uint32_t budget = DAQ_MESSAGE_MAX;
+	for (uint8_t channel = 0; channel < DAQ_CHANNELS; channel++)
+		if ((channelmask & (1 << channel)) && daq_mem_base[channel])
+			budget -= sizeof(data.block[0].head);
+	budget /= 2;
+
+	data.tagged = true;
+	for (uint8_t channel = 0; channel < DAQ_CHANNELS; channel++)
+	{
+		if (!(channelmask & (1 << channel)) || daq_mem_base[channel] == 0) continue;
+
+		HWvectorBlock &b = data.block[data.n++];
+		uint8_t s = Daq_ReadBlock(b, (blocksize < budget) ? blocksize : budget, availsize, channel);
+		uint32_t size = b.s1 + b.s2;
+		budget -= size;
+		b.head[0] = channel + (s << 8);
+		b.head[1] = uint16_t(size);
+		b.head[2] = uint16_t(size >> 16);
+		status |= s;
+	}
+	return status;
+}
+
+
+uint8_t CTestboard::Daq_ReadBlock(HWvectorBlock &data,
+		uint32_t blocksize, uint32_t &availsize, uint8_t channel)
 {
 	data.base = 0;
 	data.s1 = 0;
@@ -1617,13 +1861,16 @@ uint8_t CTestboard::Daq_Read(HWvectorR<uint16_t> &data,
 
 	if (daq_mem_base[channel] == 0) { availsize = 0; return 0; }
 
+	// a streaming channel is read by Daq_StreamService only
+	if (daq_stream_mask & (1 << channel)) { availsize = 0; return 0; }
+
 	// limit maximal block size
-	if (blocksize > 0x800000) blocksize = 0x800000;
+	if (blocksize > DAQ_MESSAGE_MAX/2) blocksize = DAQ_MESSAGE_MAX/2;
 	if (blocksize > daq_mem_size[channel]) blocksize = daq_mem_size[channel];
 
-	// read dma status
+	// read dma status (DAQ_THRES is internal, not sent to the host)
 	data.base = DAQ_DMA_BASE[channel];
-	int32_t status = DAQ_READ(data.base, DAQ_CONTROL) ^ 1;
+	int32_t status = (DAQ_READ(data.base, DAQ_CONTROL) ^ 1) & ~DAQ_THRES;
 	data.rp = DAQ_READ(data.base, DAQ_MEM_READ);
 	int32_t wp = DAQ_READ(data.base, DAQ_MEM_WRITE);
 
@@ -1970,3 +2217,46 @@ void CTestboard::VectorTest(vector<uint16_t> &in, vectorR<uint16_t> &out)
 	for (unsigned int i=0; i<out.size(); i++) out[i] += 1000;
 }
 
+
+// --- benchmark -----------------------------------------------------------
+
+#define BENCH_WORDS 32768
+
+static uint16_t bench_data[BENCH_WORDS];
+static bool bench_init = false;
+
+uint32_t CTestboard::Bench_Upload(vector<uint16_t> &data)
+{
+	return data.size();
+}
+
+
+void CTestboard::Bench_UsbBytewise(bool on)
+{
+	usb.SetBytewiseRead(on);
+}
+
+
+void CTestboard::Bench_Download(uint32_t words, HWvectorR<uint16_t> &data)
+{
+	if (!bench_init)
+	{
+		for (uint32_t i=0; i<BENCH_WORDS; i++) bench_data[i] = uint16_t(i);
+		bench_init = true;
+	}
+
+	// the pattern buffer is sent repeatedly, up to 2*DAQ_CHANNELS times
+	data.n = 0;
+	while (words && data.n < DAQ_CHANNELS)
+	{
+		HWvectorBlock &b = data.block[data.n++];
+		b.p1 = b.p2 = bench_data;
+		b.s1 = (words > BENCH_WORDS) ? BENCH_WORDS : words;
+		words -= b.s1;
+		b.s2 = (words > BENCH_WORDS) ? BENCH_WORDS : words;
+		words -= b.s2;
+		b.base = 0; // nothing to commit
+		b.rp = 0;
+	}
+}
+
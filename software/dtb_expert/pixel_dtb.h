@@ -4,7 +4,12 @@
 
 #include "dtb_hal.h"
 #include "rpc.h"
+#include "ethernet.h"
 #include "FlashMemory.h"
+#include "pixel_map.h"
+#include "i2c_queue.h"
+#include "scan.h"
+#include "daq_memory.h"
 
 
 // size of module
@@ -26,6 +31,12 @@
 // Define number of DAQ channels
 #define DAQ_CHANNELS 8
 
+// Largest DAQ data message (bytes): 24 bit size field of the message header
+#define DAQ_MESSAGE_MAX 0xffffff
+
+// Interrupt test loops at 85% of allocated DAQ buffer (watermark):
+#define LOOP_MAX_FILLLEVEL 85
+
 // PUC register addresses for roc_SetDAC
 #define	Vdig        0x01
 #define Vana        0x02
@@ -57,14 +68,57 @@
 #define	WBC         0xFE
 #define	CtrlReg     0xFD
 
+// last state written to a ROC, roc_* functions only send what differs
+#define ROC_SHADOW_UNKNOWN 0xff
+#define ROC_SHADOW_CALS    8
+
+struct CRocShadow
+{
+	uint8_t  dac[256];
+	uint32_t dacKnown[8];
+	uint8_t  pix[ROC_NUMCOLS*ROC_NUMROWS]; // roc_Pix value or ROC_SHADOW_UNKNOWN
+	uint32_t colEnable;  // double column enable bits
+	uint32_t colKnown;
+	bool     calKnown;   // cal list complete
+	uint8_t  nCal;
+	uint16_t cal[ROC_SHADOW_CALS];  // 2*pixel + sensor_cal of the last roc_Pix_Cal
+
+	void Invalidate();
+	bool DacKnown(uint8_t reg) { return dacKnown[reg >> 5] & (1 << (reg & 31)); }
+	void SetDac(uint8_t reg, uint8_t value)
+	{ dac[reg] = value; dacKnown[reg >> 5] |= 1 << (reg & 31); }
+};
+
 template <class T> class HWvector;
 
+// uncached access to DAQ memory
+template <class T>
+#ifdef DTB_SIM
+inline T* Uncache(T *x) { return x; } // host memory has no cache bypass
+#else
+inline T* Uncache(T *x) { return (T*)(((unsigned long)x) | 0x80000000); }
+#endif
+
+// data block of one DAQ channel sent by HWvector
+struct HWvectorBlock
+{
+	uint16_t *p1;
+	uint32_t s1;
+	uint16_t *p2;
+	uint32_t s2;
+
+	uint32_t base;
+	int32_t rp;
+	uint16_t head[3]; // channel + (status << 8), size (Daq_ReadAll only)
+};
+
 
 
 class CTestboard
 {
 	CRpcIo *rpc_io;
 	CUSB usb;
+	CEthernet eth;
 
 	static const uint16_t flashUpgradeVersion;
 	uint16_t ugRecordCounter;
@@ -84,13 +138,37 @@ class CTestboard
 	// --- DAQ variables
 	uint16_t *daq_mem_base[8]; // DAQ buffer base address (0 = no space reserved)
 	uint32_t daq_mem_size[8];  // DAQ buffer size in 16 bit words
+	CDaqMemory daq_memory;     // DAQ buffer region
 	uint16_t daq_fifo_state[8];
+	uint32_t daq_watermark[8]; // loop interrupt fill level in words
+	uint8_t  daq_watermark_hw; // channels with DAQ_THRES status flag
 
 	bool daq_select_adc;
 	bool daq_select_deser160;
 	bool daq_select_deser400;
 	bool daq_select_datasim;
 
+	// --- DAQ streaming
+	uint8_t  daq_stream_mask;     // channels in streaming mode (0 = off)
+	uint8_t  daq_stream_pending;  // channels with a segment on the wire
+	uint8_t  daq_stream_next;     // round robin start channel
+	uint32_t daq_stream_segment;  // max segment size in words
+	uint32_t daq_stream_credits;  // segments the host can accept
+	int32_t  daq_stream_rp[8];    // read pointer after segment on the wire
+	uint32_t daq_stream_time[8];  // time of last segment (system ticks)
+	uint32_t daq_stream_hdr[8][2];
+	uint32_t daq_stream_count;    // segments sent
+	uint32_t daq_stream_bytes;    // data bytes sent
+	uint32_t daq_stream_start;    // start time (system ticks)
+
+	// --- DAQ pixel map (data decoded on board)
+	CPixelMap daq_map;
+	bool daq_map_active;
+	uint8_t  daq_map_wait;      // channels delivering one event per trigger
+	uint32_t daq_map_expected[8]; // events expected before the current bin
+	uint32_t daq_map_timeouts;  // bins with events missing at the bin change
+	uint32_t daq_map_missing;   // events missing, decoded into a later bin
+
 	uint32_t deser400_ena;
 	uint32_t deser400_pdena;
 
@@ -112,6 +190,18 @@ class CTestboard
 	static const unsigned char MODCONF_L1[16];
 	bool layer_1;
 
+	// ROC/TBM commands are queued, a fence waits until they are sent
+	// (before triggers, delays, readback and at the end of each RPC)
+	CI2cQueue i2c;
+	uint32_t chipMaskTime; // us
+
+	// ROC state shadow (delta programming)
+	CRocShadow roc_shadow[MOD_NUMROCS];
+	uint8_t  rocId;          // current roc_shadow index
+	uint32_t rocWritten;     // commands sent
+	uint32_t rocSkipped;     // commands suppressed by the shadow
+	uint32_t rocInvalidated; // shadow invalidations (ROC state lost)
+
 
 	void InitDac();
 	void SetDac(int addr, int value);
@@ -130,6 +220,7 @@ class CTestboard
 public:
 	CTestboard();
 	CRpcIo* GetIo() { return rpc_io; }
+	CRpcIo* RpcIoSelect();
 
 
 	// === RPC ==============================================================
@@ -141,10 +232,26 @@ public:
 
 	RPC_EXPORT int32_t GetRpcCallCount();
 	RPC_EXPORT bool    GetRpcCallName(int32_t id, stringR &callName);
+	// all call names in id order, each terminated by '\n'
+	RPC_EXPORT void    GetRpcCallNames(stringR &names);
 
 	RPC_EXPORT uint32_t GetRpcCallHash();
 	uint32_t GetHashForString(const char *s);
 
+	// --- command batching: replies of all commands between RpcBatchBegin
+	// and RpcBatchEnd are sent together with the RpcBatchEnd reply
+	RPC_EXPORT void RpcBatchBegin();
+	RPC_EXPORT uint16_t RpcBatchEnd();
+
+	// --- command profile: 7 words per command id (count, clocks low/high,
+	// min, max, flush clocks low/high), returns the clock frequency in Hz
+	RPC_EXPORT uint32_t RpcProfileGet(vectorR<uint32_t> &profile);
+	RPC_EXPORT void RpcProfileReset();
+
+	// --- allocation counters: arena allocations, arena overflows, arena
+	// peak (bytes), heap allocations, heap frees, DataSink bytes
+	RPC_EXPORT void GetRpcAllocStat(vectorR<uint32_t> &stat, bool reset);
+
 //	RPC_EXPORT uint16_t GetRpcServerCallCount();
 //	RPC_EXPORT void     GetRpcServerCallName(uint16_t index, stringR &callName);
 
@@ -186,6 +293,8 @@ public:
 	RPC_EXPORT void cDelay(uint16_t clocks);
 	RPC_EXPORT void uDelay(uint16_t us);
 	void mDelay(uint16_t ms);
+	uint32_t TimerClocks(uint32_t clocks);
+	RPC_EXPORT uint16_t GetMinTriggerSpacing();
 
 
 	// --- select ROC/Module clock source
@@ -390,19 +499,26 @@ public:
 	RPC_EXPORT void Trigger_Send( uint8_t send);
 
 	// --- data aquisition --------------------------------------------------
+	// Daq_Open returns the buffer size, limited to the largest free block
 	RPC_EXPORT uint32_t Daq_Open(uint32_t buffersize = 10000000, uint8_t channel = 0);
 	RPC_EXPORT void Daq_Close(uint8_t channel = 0);
+	// free DAQ memory in words: total and largest block (max. Daq_Open)
+	RPC_EXPORT uint32_t Daq_GetFreeMem(uint32_t &largest);
 	RPC_EXPORT void Daq_Start(uint8_t channel = 0);
 	RPC_EXPORT void Daq_Stop(uint8_t channel = 0);
 	RPC_EXPORT void Daq_MemReset(uint8_t channel = 0);
 	RPC_EXPORT uint32_t Daq_GetSize(uint8_t channel = 0);
+	// open channels with a selected data source
+	uint8_t Daq_DataChannels();
 	RPC_EXPORT uint8_t Daq_FillLevel(uint8_t channel);
 	RPC_EXPORT uint8_t Daq_FillLevel();
 
-	uint8_t Daq_Read(vectorR<uint16_t> &data,
+	// copy to a vector (reference for the zero copy HWvector read),
+	// at most DAQMEM_COPY_MAX/2 words (2M) per call
+	RPC_EXPORT uint8_t Daq_Read(vectorR<uint16_t> &data,
 			 uint32_t blocksize = 65536, uint8_t channel = 0);
 
-	uint8_t Daq_Read(vectorR<uint16_t> &data,
+	RPC_EXPORT uint8_t Daq_Read(vectorR<uint16_t> &data,
 			uint32_t blocksize, uint32_t &availsize, uint8_t channel = 0);
 
 	RPC_EXPORT uint8_t Daq_Read(HWvectorR<uint16_t> &data,
@@ -411,6 +527,15 @@ public:
 	RPC_EXPORT uint8_t Daq_Read(HWvectorR<uint16_t> &data,
 			uint32_t blocksize, uint32_t &availsize, uint8_t channel = 0);
 
+	// read all channels in channelmask, each block starts with a header:
+	// uint16_t channel + (status << 8), uint32_t block size in words.
+	// blocksize limits each channel, all blocks share one data message of
+	// at most DAQ_MESSAGE_MAX bytes (lower channels first).
+	RPC_EXPORT uint8_t Daq_ReadAll(HWvectorR<uint16_t> &data,
+			uint32_t blocksize, uint8_t channelmask);
+
+	uint8_t Daq_ReadBlock(HWvectorBlock &data,
+			uint32_t blocksize, uint32_t &availsize, uint8_t channel);
 	void Daq_Read_DeleteData(uint32_t daq_base, int32_t rp);
 
 	RPC_EXPORT void Daq_Select_ADC(uint16_t blocksize, uint8_t source,
@@ -454,10 +579,23 @@ public:
 
 
 	// --- ROC/module Communication -----------------------------------------
+	// -- wait until all queued ROC/TBM commands are sent
+	void I2cFence() { i2c.Fence(); }
+
+	// -- forget the ROC state shadow (state of ROCs changed externally)
+	RPC_EXPORT void roc_ShadowInvalidate();
+
+	// -- commands sent / suppressed by the ROC state shadow
+	RPC_EXPORT uint32_t roc_ShadowStat(uint32_t &skipped);
+
 	// -- set the i2c address for the following commands
 	RPC_EXPORT void roc_I2cAddr(uint8_t id);
 	RPC_EXPORT void roc_I2cAddr_Layer_1(uint8_t id);
 
+	// -- ROCs with inverted row address (psi46digV2), used by the pixel map
+	//    from the next Daq_MapStart
+	RPC_EXPORT void SetPixelAddressInverted(bool status);
+
 	// -- sends "ClrCal" command to ROC
 	RPC_EXPORT void roc_ClrCal();
 
@@ -489,6 +627,9 @@ public:
 	// -- mask all pixels and columns of the chip
 	RPC_EXPORT void roc_Chip_Mask();
 
+	// -- duration of the last roc_Chip_Mask in us
+	RPC_EXPORT uint32_t roc_Chip_Mask_Time();
+
 	// --- TBM
 	RPC_EXPORT bool TBM_Present();
 
@@ -512,11 +653,16 @@ public:
 
 	// Wafer test functions
 	RPC_EXPORT bool TestColPixel(uint8_t col, uint8_t trimbit, bool sensor_cal, vectorR<uint8_t> &res);
+	RPC_EXPORT void SetFindLevelMode(uint8_t mode); // 0 = linear, 1 = adaptive (default)
+	RPC_EXPORT uint32_t GetFindLevelSteps(bool reset); // GetPixel calls
  
-	// Ethernet test functions
+	// Ethernet RPC interface (MAC-ADDRESS of DTB.INI), commands are
+	// served on the interface they arrive on
 	bool Ethernet_Init();
 	RPC_EXPORT void Ethernet_Send(string &message);
 	RPC_EXPORT uint32_t Ethernet_RecvPackets();
+	// frames received, sequence gaps, frames sent
+	RPC_EXPORT uint32_t Ethernet_GetStat(uint32_t &lost, uint32_t &sent);
 
 
 
@@ -528,34 +674,66 @@ public:
 	// Test Loop parameters
 	uint16_t LoopTriggerDelay;
 	uint16_t LoopTrimDelay;
+	uint8_t  LoopTriggerMode;
+	uint32_t LoopTriggerPaced;    // triggers sent in paced mode
+	uint32_t LoopTriggerTimeouts; // paced triggers without complete readout
+	uint8_t  LoopTriggerIdle;     // channels without data at the last timeout
 
 	// Loop parameter storage for interrupts:
 	bool LoopInterrupt;
 	uint16_t LoopInterruptId;
 	uint16_t LoopInterruptCounter;
 
-	uint8_t LoopInterruptColumn;
-	uint8_t LoopInterruptRow;
-	size_t LoopInterruptDac1;
-	uint8_t LoopInterruptDac1Stepsize;
-	size_t LoopInterruptDac2;
-	uint8_t LoopInterruptDac2Stepsize;
+	uint32_t LoopInterruptRocWritten;
+	uint32_t LoopInterruptRocInvalidated;
+
+	// Preamble skipped on resume:
+	uint32_t LoopPreambleTime; // us
+	uint32_t LoopResumeCount;
+	uint32_t LoopResumeSaved;  // us
 
 	// Not exported internal helper functions:
 	uint8_t GetXtalkRow(uint8_t row, bool xtalk);
 	size_t CalibratedDAC(uint8_t register, size_t value);
 
 	RPC_EXPORT void LoopInterruptReset();
-	void LoopInterruptResume(uint16_t id, uint8_t &column, uint8_t &row, size_t &dac1, uint8_t &dac1step, size_t &dac2, uint8_t &dac2step);
-	void LoopInterruptStore(uint16_t id, uint8_t column, uint8_t row, size_t dac1, uint8_t dac1step, size_t dac2, uint8_t dac2step);
+	bool LoopInterruptResume(uint16_t id, bool &keep);
+	void LoopInterruptStore(uint16_t id);
 	bool LoopInterruptStatus();
+	void LoopPreambleDone(uint32_t start);
+	RPC_EXPORT uint32_t LoopGetResumeStat(uint32_t &saved_us);
 
 	RPC_EXPORT void SetLoopTriggerDelay(uint16_t delay);
 	RPC_EXPORT void SetLoopTrimDelay(uint16_t delay);
 	uint16_t GetLoopTriggerDelay(uint16_t nTriggers);
+
+	// LOOP_TRIGGER_FIXED: wait GetLoopTriggerDelay clocks before each trigger
+	// LOOP_TRIGGER_PACED: next trigger as soon as the DAQ data of the
+	//   previous one is complete (write pointers of the running channels
+	//   with a data source advanced and quiet for LOOP_READOUT_QUIET +
+	//   SetLoopTriggerDelay clocks)
+	#define LOOP_TRIGGER_FIXED 0
+	#define LOOP_TRIGGER_PACED 1
+	RPC_EXPORT void SetLoopTriggerMode(uint8_t mode);
+	RPC_EXPORT uint32_t GetLoopTriggerStat(uint32_t &timeouts);
+	void LoopTrigger(uint16_t delay);
 	RPC_EXPORT bool SetI2CAddresses(vector<uint8_t> &roc_i2c);
 	RPC_EXPORT bool SetTrimValues(uint8_t roc_i2c, vector<uint8_t> &trimvalues);
-	void LoopPixTrim(uint8_t roc_i2c, uint8_t column, uint8_t row);
+
+	// Generic scan: pixel set x up to SCAN_MAXAXES nested axes (see scan.h).
+	// Scan_Set selects the ROCs and all pixels and clears the axes,
+	// pixels = (column << 8) + row, an empty pixel set scans the axes only.
+	// Scan_Run returns false if interrupted, call again to resume, or if
+	// the descriptor was rejected (a Scan_Set* or Scan_AddAxis failed).
+	CScan scan;
+	bool ScanSetRocs(const uint8_t *roc_i2c, uint8_t nrocs, uint16_t nTriggers, uint16_t flags);
+	bool ScanSetPixel(uint8_t column, uint8_t row);
+	void ScanPixel(bool on);
+	void ScanSetAxis(uint8_t a);
+	RPC_EXPORT bool Scan_Set(vector<uint8_t> &roc_i2c, uint16_t nTriggers, uint16_t flags);
+	RPC_EXPORT bool Scan_SetPixels(vector<uint16_t> &pixels);
+	RPC_EXPORT bool Scan_AddAxis(uint8_t type, uint8_t reg, uint16_t low, uint16_t high, uint16_t step);
+	RPC_EXPORT bool Scan_Run();
 
 	// Exported RPC-Calls for Maps
 	RPC_EXPORT bool LoopMultiRocAllPixelsCalibrate(vector<uint8_t> &roc_i2c, uint16_t nTriggers, uint16_t flags);
@@ -592,8 +770,48 @@ public:
 
 	RPC_EXPORT void VectorTest(vector<uint16_t> &in, vectorR<uint16_t> &out);
 
+	// --- benchmark --------------------------------------------------------
+	// Payload sink and source for transfer rate measurements by the host.
+	// Bench_Download sends a counter pattern of up to 2*DAQ_CHANNELS*32768
+	// words without copy. Scan_GetStat returns the time in us spent in the
+	// last Loop* scan (summed over interrupted calls) and the number of
+	// points done, each point is one pixel at one DAC setting.
+	// Bench_UsbBytewise switches the USB receive path back to the byte by
+	// byte read of the old firmware, the reference of the upload rate.
+	RPC_EXPORT uint32_t Bench_Upload(vector<uint16_t> &data);
+	RPC_EXPORT void Bench_Download(uint32_t words, HWvectorR<uint16_t> &data);
+	RPC_EXPORT void Bench_UsbBytewise(bool on);
+	RPC_EXPORT uint32_t Scan_GetStat(uint32_t &points);
+
 	// --- Read Arbitrary adc     ------------------------------------------
 	RPC_EXPORT uint16_t GetADC(uint8_t addr);
+
+	// --- DAQ streaming ----------------------------------------------------
+	// While streaming, segments of the selected channels are pushed to the
+	// host as RPC_TYPE_DTB_STREAM messages, one credit per segment.
+	// Daq_Read and Daq_ReadAll return no data for these channels.
+	RPC_EXPORT bool Daq_StreamStart(uint8_t channelmask, uint32_t segmentsize, uint16_t credits);
+	RPC_EXPORT void Daq_StreamCredit(uint16_t credits);
+	RPC_EXPORT uint32_t Daq_StreamStop(uint32_t &bytes, uint32_t &time_ms);
+	bool Daq_StreamService();
+	void Daq_StreamRemove(uint8_t channel);
+
+	// --- DAQ pixel map
+	// While active, the DAQ buffers are decoded into per pixel hit counts
+	// and pulse height sums (all open channels). The ROC index is
+	// channel*rocs_per_channel + position in readout chain.
+	// With nbins > 1 an efficiency curve is filled for each pixel, the
+	// DAC scan loops select the bin (DAC step).
+	RPC_EXPORT bool Daq_MapStart(uint8_t nrocs, uint8_t rocs_per_channel, uint16_t nbins = 1);
+	RPC_EXPORT uint32_t Daq_MapStop(uint32_t &errors);
+	RPC_EXPORT void Daq_MapSetBin(uint16_t bin, uint16_t nTriggers);
+	// bins with events missing after DAQ_MAP_TIMEOUT, events missing
+	RPC_EXPORT uint32_t Daq_MapGetStat(uint32_t &missing);
+	RPC_EXPORT void Daq_MapGetHits(HWvectorR<uint16_t> &hits);
+	RPC_EXPORT void Daq_MapGetPhSum(uint8_t roc, vectorR<uint32_t> &phsum);
+	RPC_EXPORT void Daq_MapGetEff(uint8_t roc, vectorR<uint8_t> &eff);
+	RPC_EXPORT void Daq_MapGetThreshold(uint8_t roc, uint8_t nTriggers, vectorR<uint16_t> &threshold);
+	void Daq_MapUpdate();
 };
 
 
@@ -602,16 +820,16 @@ extern CTestboard tb;
 template <class T>
 class HWvector
 {
-	uint16_t *p1;
-	uint32_t s1;
-	uint16_t *p2;
-	uint32_t s2;
-
-	uint32_t base;
-	uint32_t rp;
+	uint8_t n;    // number of blocks
+	bool tagged;  // send block headers
+	HWvectorBlock block[DAQ_CHANNELS];
 public:
-	HWvector() {}
-	~HWvector() { tb.Daq_Read_DeleteData(base, rp); }
+	HWvector() : n(0), tagged(false) {}
+	~HWvector()
+	{ // commit read pointers after transmission
+		for (uint8_t i=0; i<n; i++)
+			if (block[i].base) tb.Daq_Read_DeleteData(block[i].base, block[i].rp);
+	}
 	void Write(rpcMessage &msg, uint32_t &hdr);
 	friend class CTestboard;
 };
@@ -619,9 +837,19 @@ public:
 template <class T>
 void HWvector<T>::Write(rpcMessage &msg, uint32_t &hdr)
 {
-	uint32_t size = (s1 + s2)*sizeof(uint16_t);
+	uint32_t size = 0;
+	for (uint8_t i=0; i<n; i++)
+	{
+		size += (block[i].s1 + block[i].s2)*sizeof(uint16_t);
+		if (tagged) size += sizeof(block[i].head);
+	}
 	hdr = (size << 8) + RPC_TYPE_DTB_DATA;
 	msg.GetIo().Write(&hdr, sizeof(uint32_t));
-	if (s1) msg.GetIo().Write(p1, s1*sizeof(uint16_t));
-	if (s2)	msg.GetIo().Write(p2, s2*sizeof(uint16_t));
+	for (uint8_t i=0; i<n; i++)
+	{
+		HWvectorBlock &b = block[i];
+		if (tagged) msg.GetIo().Write(b.head, sizeof(b.head));
+		if (b.s1) msg.GetIo().Write(b.p1, b.s1*sizeof(uint16_t));
+		if (b.s2) msg.GetIo().Write(b.p2, b.s2*sizeof(uint16_t));
+	}
 }
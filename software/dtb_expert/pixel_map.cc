@@ -0,0 +1,180 @@
+// pixel_map.cc
+
+#include <string.h>
+#include "pixel_map.h"
+
+
+bool CPixelMap::Init(uint8_t rocs, uint8_t rocs_per_channel, bool deser400, bool invert,
+	uint16_t bins)
+{
+	if (rocs == 0 || rocs > PIXMAP_MAXROCS) return false;
+	if (rocs_per_channel == 0) return false;
+	if (bins == 0 || bins > PIXMAP_MAXBINS) return false;
+
+	if (rocs != nrocs || bins != nbins)
+	{
+		Free();
+		hits  = new uint16_t[rocs*PIXMAP_NUMPIXELS];
+		phsum = new uint32_t[rocs*PIXMAP_NUMPIXELS];
+		if (bins > 1) eff = new uint8_t[rocs*PIXMAP_NUMPIXELS*bins];
+		if (hits == 0 || phsum == 0 || (bins > 1 && eff == 0)) { Free(); return false; }
+		nrocs = rocs;
+		nbins = bins;
+	}
+	rocsPerChannel = rocs_per_channel;
+	module = deser400;
+	inverted = invert;
+	Clear();
+	return true;
+}
+
+
+void CPixelMap::Free()
+{
+	if (hits)  delete[] hits;
+	if (phsum) delete[] phsum;
+	if (eff)   delete[] eff;
+	hits = 0;
+	phsum = 0;
+	eff = 0;
+	nrocs = 0;
+	nbins = 0;
+}
+
+
+void CPixelMap::Clear()
+{
+	for (uint8_t ch = 0; ch < PIXMAP_CHANNELS; ch++)
+	{
+		dec[ch].roc = -1;
+		dec[ch].half = false;
+		dec[ch].raw = 0;
+		chEvents[ch] = 0;
+	}
+	events = errors = 0;
+	bin = 0;
+	if (nrocs == 0) return;
+	memset(hits,  0, nrocs*PIXMAP_NUMPIXELS*sizeof(uint16_t));
+	memset(phsum, 0, nrocs*PIXMAP_NUMPIXELS*sizeof(uint32_t));
+	if (eff) memset(eff, 0, nrocs*PIXMAP_NUMPIXELS*nbins);
+}
+
+
+// raw = 24 bit pixel hit:
+//   c1(3) c0(3) r2(3) r1(3) r0(3) ph(4+4, bit 4 = 0)
+void CPixelMap::Pixel(uint8_t channel, uint32_t raw)
+{
+	int8_t pos = dec[channel].roc;
+	if (pos < 0 || pos >= rocsPerChannel) { errors++; return; }
+	uint16_t roc = channel*rocsPerChannel + pos;
+	if (roc >= nrocs) { errors++; return; }
+
+	if (inverted) raw ^= 0x03fe00; // r2 r1 r0
+
+	uint16_t c = ((raw >> 21) & 7)*6 + ((raw >> 18) & 7);
+	uint16_t r = ((raw >> 15) & 7)*36 + ((raw >> 12) & 7)*6 + ((raw >> 9) & 7);
+	uint16_t col = 2*c + (r & 1);
+	uint16_t r2 = r/2;
+	if (col >= PIXMAP_NUMCOLS || r2 == 0 || r2 > PIXMAP_NUMROWS) { errors++; return; }
+	uint16_t row = PIXMAP_NUMROWS - r2;
+
+	uint32_t i = roc*PIXMAP_NUMPIXELS + col*PIXMAP_NUMROWS + row;
+	if (hits[i] != 0xffff) hits[i]++;
+	phsum[i] += (raw & 0x0f) + ((raw >> 1) & 0xf0);
+
+	if (eff && bin < nbins)
+	{
+		uint8_t &e = eff[i*nbins + bin];
+		if (e != 0xff) e++;
+	}
+}
+
+
+// Returns the position of the first 50% crossing of an efficiency
+// curve in 1/16 bins (linear interpolation between the two bins).
+// Works for rising and falling curves. PIXMAP_NO_THRESHOLD if the
+// curve does not cross the 50% level.
+uint16_t CPixelMap::Threshold(const uint8_t *curve, uint16_t bins, uint8_t ntrig)
+{
+	if (bins < 2 || ntrig == 0) return PIXMAP_NO_THRESHOLD;
+
+	bool above = 2*curve[0] >= ntrig;
+	for (uint16_t k = 1; k < bins; k++)
+	{
+		if ((2*curve[k] >= ntrig) == above) continue;
+
+		// interpolate between bin k-1 and k (hit counts doubled)
+		int32_t y0 = 2*curve[k-1];
+		int32_t y1 = 2*curve[k];
+		int32_t frac = ((int32_t(ntrig) - y0)*16)/(y1 - y0);
+		if (frac < 0) frac = 0;
+		if (frac > 16) frac = 16;
+		return (k-1)*16 + frac;
+	}
+	return PIXMAP_NO_THRESHOLD;
+}
+
+
+// Decodes a block of DAQ data. Events may be split across blocks,
+// the decoder state is kept per channel.
+void CPixelMap::Decode(uint8_t channel, const uint16_t *data, uint32_t size)
+{
+	if (nrocs == 0 || channel >= PIXMAP_CHANNELS) return;
+
+	Decoder &d = dec[channel];
+	const uint16_t *end = data + size;
+
+	if (module)
+	{ // DESER400: word type in bits 15..13
+		while (data < end)
+		{
+			uint16_t x = *data++;
+			switch (x & 0xe000)
+			{
+			case 0xa000: // TBM header
+				d.roc = -1;
+				d.half = false;
+				events++;
+				chEvents[channel]++;
+				break;
+			case 0x4000: // ROC header
+				d.roc++;
+				d.half = false;
+				break;
+			case 0x0000: // pixel hit, 1st half
+				d.raw = uint32_t(x & 0x0fff) << 12;
+				d.half = true;
+				break;
+			case 0x2000: // pixel hit, 2nd half
+				if (d.half) Pixel(channel, d.raw + (x & 0x0fff));
+				d.half = false;
+				break;
+			default: // 2nd TBM header word, TBM trailer
+				d.half = false;
+			}
+		}
+	}
+	else
+	{ // DESER160: ROC header, pixel hits as pairs of 12 bit words
+		while (data < end)
+		{
+			uint16_t x = *data++;
+			if (x & 0x8000)
+			{
+				if ((x & 0x8ffc) == 0x87f8) { d.roc = 0; events++; chEvents[channel]++; }
+				else { d.roc = -1; errors++; }
+				d.half = false;
+			}
+			else if (d.half)
+			{
+				Pixel(channel, d.raw + (x & 0x0fff));
+				d.half = false;
+			}
+			else
+			{
+				d.raw = uint32_t(x & 0x0fff) << 12;
+				d.half = true;
+			}
+		}
+	}
+}
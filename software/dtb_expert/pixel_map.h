@@ -0,0 +1,68 @@
+// pixel_map.h
+// Pixel map accumulator: decodes raw DAQ data (DESER160 single ROC or
+// DESER400 module format) into per pixel hit counts and pulse height sums.
+// For DAC scans an 8 bit efficiency curve (hits per bin) is filled for
+// each pixel, bin = DAC step selected by SetBin().
+// No hardware access, compiles on the host for checks with recorded data.
+
+#pragma once
+
+#include "cstdint.h"
+
+
+#define PIXMAP_NUMROWS    80
+#define PIXMAP_NUMCOLS    52
+#define PIXMAP_NUMPIXELS  (PIXMAP_NUMCOLS*PIXMAP_NUMROWS)
+#define PIXMAP_MAXROCS    16
+#define PIXMAP_CHANNELS   8
+#define PIXMAP_MAXBINS    256
+#define PIXMAP_NO_THRESHOLD 0xffff
+
+
+class CPixelMap
+{
+	// decoder state of one DAQ channel
+	struct Decoder
+	{
+		int8_t roc;    // ROC position in readout chain (-1 = no header)
+		bool half;     // first half of a pixel hit received
+		uint32_t raw;  // pixel hit under construction
+	};
+	Decoder dec[PIXMAP_CHANNELS];
+
+	bool module;     // DESER400 data format
+	bool inverted;   // row address bits inverted (psi46digV2)
+	uint8_t nrocs;
+	uint8_t rocsPerChannel;
+	uint16_t nbins;
+	uint16_t bin;    // current bin of efficiency curves
+
+	uint16_t *hits;  // [roc][col*PIXMAP_NUMROWS + row]
+	uint32_t *phsum;
+	uint8_t  *eff;   // [roc][pixel][bin], only if nbins > 1
+	uint32_t events; // event headers (TBM or ROC header for single ROC)
+	uint32_t chEvents[PIXMAP_CHANNELS];
+	uint32_t errors; // invalid pixel addresses or ROC positions
+
+	void Pixel(uint8_t channel, uint32_t raw);
+public:
+	CPixelMap() : nrocs(0), nbins(0), hits(0), phsum(0), eff(0) { Clear(); }
+	~CPixelMap() { Free(); }
+	bool Init(uint8_t rocs, uint8_t rocs_per_channel, bool deser400, bool invert,
+		uint16_t bins = 1);
+	void Free();
+	void Clear();
+	void Decode(uint8_t channel, const uint16_t *data, uint32_t size);
+	void SetBin(uint16_t b) { bin = b; }
+
+	uint8_t  GetRocs() { return nrocs; }
+	uint16_t GetBins() { return nbins; }
+	uint32_t GetEvents() { return events; }
+	uint32_t GetEvents(uint8_t channel) { return chEvents[channel]; }
+	uint32_t GetErrors() { return errors; }
+	uint16_t* GetHits(uint8_t roc = 0) { return hits + roc*PIXMAP_NUMPIXELS; }
+	uint32_t* GetPhSum(uint8_t roc = 0) { return phsum + roc*PIXMAP_NUMPIXELS; }
+	uint8_t*  GetEff(uint8_t roc = 0) { return eff + roc*PIXMAP_NUMPIXELS*nbins; }
+
+	static uint16_t Threshold(const uint8_t *curve, uint16_t bins, uint8_t ntrig);
+};
@@ -7,6 +7,14 @@
 #include "pixel_dtb.h"
 
 
+// threshold search of FindLevel
+#define FINDLEVEL_LINEAR   0
+#define FINDLEVEL_ADAPTIVE 1
+
+unsigned char findLevelMode = FINDLEVEL_ADAPTIVE;
+unsigned int getPixelCount = 0; // number of GetPixel calls
+
+
 int PixelFired(const vector<uint16_t> &x, unsigned int &pos)
 {
 	// check header
@@ -28,6 +36,7 @@ int GetPixel(unsigned int x)
 	const unsigned int count = 20;
 	unsigned int i;
 	unsigned int n = 0;
+	getPixelCount++;
 	tb.roc_SetDAC(Vcal, x);
 	tb.uDelay(30);
 
@@ -38,7 +47,7 @@ int GetPixel(unsigned int x)
 		tb.uDelay(5);
 	}
 	tb.Daq_Stop();
-	vector<uint16_t> data;
+	static vector<uint16_t> data; // reused, no allocation per call
 	tb.Daq_Read(data, 10000);
 	unsigned int pos = 0;
 
@@ -117,7 +126,7 @@ bool CTestboard::TestColPixel(uint8_t col, uint8_t trimbit, bool sensor_cal, vec
 */
 
 
-int FindLevel(unsigned char x)
+int FindLevelLinear(unsigned char x)
 {
 	//static unsigned char x = 9;  // now passed as an argument
 	//if (x>253) x = 200; else if (x<1) x=1;
@@ -148,6 +157,57 @@ int FindLevel(unsigned char x)
 }
 
 
+// Returns the same level as FindLevelLinear (lowest firing Vcal,
+// limited to 1..253) if the pixel response is monotonic.
+// Steps away from the start value with doubling step size until
+// the response changes, then bisection: O(log 256) GetPixel calls.
+int FindLevelAdaptive(unsigned char x)
+{
+	// GetPixel(lo) == 0, GetPixel(hi) > 0 (assumed at the limits)
+	int lo = 0, hi = 253;
+	if (x < 1) x = 1; else if (x > 252) x = 252;
+
+	int res = GetPixel(x);
+	if (res < 0) return res;
+	if (res > 0)
+	{
+		hi = x;
+		for (int step = 1; hi - step > 0; step *= 2)
+		{
+			res = GetPixel(hi - step);
+			if (res < 0) return res;
+			if (res > 0) hi -= step; else { lo = hi - step; break; }
+		}
+	}
+	else
+	{
+		lo = x;
+		for (int step = 1; lo + step < 253; step *= 2)
+		{
+			res = GetPixel(lo + step);
+			if (res < 0) return res;
+			if (res > 0) { hi = lo + step; break; } else lo += step;
+		}
+	}
+
+	while (hi - lo > 1)
+	{
+		int y = (lo + hi)/2;
+		res = GetPixel(y);
+		if (res < 0) return res;
+		if (res > 0) hi = y; else lo = y;
+	}
+	return hi;
+}
+
+
+int FindLevel(unsigned char x)
+{
+	if (findLevelMode == FINDLEVEL_LINEAR) return FindLevelLinear(x);
+	return FindLevelAdaptive(x);
+}
+
+
 bool sensorCal = false;
 
 int test_PUC(unsigned char col, unsigned char row, unsigned char trim)
@@ -188,3 +248,17 @@ bool CTestboard::TestColPixel(uint8_t col, uint8_t trimbit, bool sensor_cal, vec
 	tb.roc_Col_Enable(col, 0);
 	return good;
 }
+
+
+void CTestboard::SetFindLevelMode(uint8_t mode)
+{
+	findLevelMode = mode;
+}
+
+
+uint32_t CTestboard::GetFindLevelSteps(bool reset)
+{
+	uint32_t n = getPixelCount;
+	if (reset) getPixelCount = 0;
+	return n;
+}
@@ -3,30 +3,152 @@
 #include "pixel_dtb.h"
 #include "rpc.h"
 #include <string.h>
+#include <stdlib.h>
+#include "sys/alt_stdio.h"
 
-class CBuffer
+CRpcError rpc_error;
+CRpcBatch rpc_batch;
+CRpcProfile rpc_profile;
+CRpcArena rpc_arena;
+
+
+// === request arena ========================================================
+
+static uint8_t rpc_arena_mem[RPC_ARENA_SIZE] __attribute__ (( aligned (8) ));
+
+void* CRpcArena::Alloc(uint32_t size)
 {
-	uint8_t *p;
-public:
-	CBuffer(uint32_t size) { p = new uint8_t[size]; }
-	~CBuffer() { delete[] p; }
-	uint8_t* operator&() { return p; }
-};
+	size = (size + 7) & ~7;
+	if (size > RPC_ARENA_SIZE - fill) { overflows++; return 0; }
+	void *p = rpc_arena_mem + fill;
+	fill += size;
+	if (fill > peak) peak = fill;
+	allocs++;
+	return p;
+}
 
 
-CRpcError rpc_error;
+bool CRpcArena::Owns(const void *p)
+{
+	return p >= rpc_arena_mem && p < rpc_arena_mem + RPC_ARENA_SIZE;
+}
 
 
-int32_t rpc_GetRpcCallId(string &cmdName)
+void CRpcArena::ResetStat()
+{
+	allocs = overflows = peak = 0;
+	heapAllocs = heapFrees = 0;
+	sinkBytes = 0;
+}
+
+
+// Out of memory is fatal: without exceptions a NULL result would be used
+// unchecked by the STL. Reported without heap use, halted with all LEDs on.
+static void rpc_OutOfMemory()
+{
+	alt_putstr("out of memory\n");
+	_SetLED(0x0f);
+	abort();
+}
+
+
+// all C++ allocations pass the arena, arena memory is never freed
+void* operator new(size_t size)
+{
+	if (rpc_arena.active)
+	{
+		void *p = rpc_arena.Alloc(size);
+		if (p) return p;
+	}
+	rpc_arena.heapAllocs++;
+	void *p = malloc(size);
+	if (!p) rpc_OutOfMemory();
+	return p;
+}
+
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+
+void operator delete(void *p)
+{
+	if (!p || rpc_arena.Owns(p)) return;
+	rpc_arena.heapFrees++;
+	free(p);
+}
+
+
+void operator delete[](void *p)
 {
+	operator delete(p);
+}
+
+
+void CRpcProfile::Reset()
+{
+	if (!cmd) cmd = new CRpcProfileEntry[rpc_cmdListSize];
 	for (uint16_t i = 0; i<rpc_cmdListSize; i++)
 	{
-		if (strcmp(cmdName.c_str(), rpc_cmdlist[i].name) == 0) return i;
+		CRpcProfileEntry &e = cmd[i];
+		e.count = 0;
+		e.clk = 0;
+		e.min = 0xffffffff;
+		e.max = 0;
+		e.flush = 0;
+	}
+}
+
+
+// command ids sorted by name (built on first use)
+static uint16_t *rpc_sortedIds = 0;
+
+static void rpc_SortCallIds()
+{
+	rpc_sortedIds = new uint16_t[rpc_cmdListSize];
+	for (uint16_t i = 0; i<rpc_cmdListSize; i++)
+	{ // insertion sort
+		uint16_t k = i;
+		while (k > 0 && strcmp(rpc_cmdlist[rpc_sortedIds[k-1]].name, rpc_cmdlist[i].name) > 0)
+		{
+			rpc_sortedIds[k] = rpc_sortedIds[k-1];
+			k--;
+		}
+		rpc_sortedIds[k] = i;
+	}
+}
+
+
+int32_t rpc_GetRpcCallId(string &cmdName)
+{
+	if (!rpc_sortedIds) rpc_SortCallIds();
+
+	// binary search
+	int32_t lo = 0, hi = rpc_cmdListSize - 1;
+	while (lo <= hi)
+	{
+		int32_t m = (lo + hi) / 2;
+		int c = strcmp(cmdName.c_str(), rpc_cmdlist[rpc_sortedIds[m]].name);
+		if (c == 0) return rpc_sortedIds[m];
+		if (c < 0) hi = m - 1; else lo = m + 1;
 	}
 	return -1;
 }
 
 
+void rpc_GetRpcCallNames(string &names)
+{
+	names.clear();
+	for (uint16_t i = 0; i<rpc_cmdListSize; i++)
+	{
+		names += rpc_cmdlist[i].name;
+		names += '\n';
+	}
+}
+
+
 
 bool rpcMessage::SendCmd()
 {
@@ -98,26 +220,32 @@ bool rpcMessage::RecvDat()
 }
 
 
+// one bulk read, the string is zero filled by resize like a vector
 bool rpcMessage::RecvString(string &x)
 {
 	if (!RecvDat()) return false;
 	uint32_t size = GetDatSize();
-	x.clear();
-	x.reserve(size);
-	char ch;
-	for (uint8_t i=0; i<size; i++)
+	if (size > RPC_RECV_MAX)
 	{
-		if (!io->Read(&ch, 1)) THROW(TIMEOUT)
-		x.push_back(ch);
+		DataSink(size);
+		THROW(WRONG_DATA_SIZE);
 	}
+	x.clear();
+	x.resize(size);
+	if (size) if (!io->Read(&(x[0]), size)) THROW(TIMEOUT)
 	RETURN_OK
 }
 
 
+// discard a payload in blocks of the parameter buffer
 void rpcMessage::DataSink(uint32_t size)
 {
-	if (size == 0) return;
-	CBuffer buffer(size);
-	io->Read(&buffer, size);
+	rpc_arena.sinkBytes += size;
+	while (size)
+	{
+		uint32_t n = (size > sizeof(m_data.par)) ? sizeof(m_data.par) : size;
+		if (!io->Read(m_data.par, n)) return;
+		size -= n;
+	}
 }
 
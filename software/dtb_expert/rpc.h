@@ -20,6 +20,7 @@ using namespace std;
 #define RPC_TYPE_DTB          0xC0
 #define RPC_TYPE_DTB_DATA     0xC2
 #define RPC_TYPE_DTB_DATA_OLD 0xC1
+#define RPC_TYPE_DTB_STREAM   0xC3
 
 #define RPC_EXPORT
 
@@ -45,10 +46,89 @@ extern const CRpcCall rpc_cmdlist[];
 
 inline uint16_t rpc_GetRpcVersion() { return RPC_DTB_VERSION; }
 int32_t  rpc_GetRpcCallId(string &cmdName);
+void rpc_GetRpcCallNames(string &names);
 
 void rpc_Dispatcher(CRpcIo &rpc_io);
 
 
+// command batching: replies are collected and sent with one flush
+struct CRpcBatch
+{
+	bool active;
+	uint16_t replies; // number of deferred replies
+	CRpcBatch() : active(false), replies(0) {}
+	void Begin() { active = true; replies = 0; }
+	uint16_t End() { active = false; return replies; }
+};
+
+extern CRpcBatch rpc_batch;
+
+
+// command profile: calls and time in sys_timer clocks (Time_clk) per
+// command id, measured by the dispatcher. flush is the part of the time
+// spent in rpcMessage::Flush (USB transfer).
+struct CRpcProfileEntry
+{
+	uint32_t count;
+	uint64_t clk;
+	uint32_t min;
+	uint32_t max;
+	uint64_t flush;
+};
+
+struct CRpcProfile
+{
+	CRpcProfileEntry *cmd; // rpc_cmdListSize entries
+	uint32_t flush;        // running sum of Flush clocks
+	CRpcProfile() : cmd(0), flush(0) {}
+	void Reset();
+	void Add(uint16_t id, uint32_t clk, uint32_t flush_clk)
+	{
+		CRpcProfileEntry &e = cmd[id];
+		e.count++;
+		e.clk += clk;
+		if (clk < e.min) e.min = clk;
+		if (clk > e.max) e.max = clk;
+		e.flush += flush_clk;
+	}
+};
+
+extern CRpcProfile rpc_profile;
+
+
+// request arena: the storage of the vectors received by a command is
+// taken from a fixed area instead of the heap and released by Reset after
+// the command. Larger vectors and all other allocations use the heap.
+// Zero initialized (no constructor), operator new may be called before
+// the static constructors have run.
+#define RPC_ARENA_SIZE 0x10000
+
+// largest received vector or string (bytes), larger payloads are
+// discarded (heap reserve, see DAQMEM_RESERVE)
+#define RPC_RECV_MAX (1 << 20)
+
+struct CRpcArena
+{
+	bool active;  // operator new allocates from the arena
+	uint32_t fill;
+
+	// counters
+	uint32_t allocs;     // arena allocations
+	uint32_t overflows;  // allocations too large for the arena
+	uint32_t peak;       // max fill
+	uint32_t heapAllocs;
+	uint32_t heapFrees;
+	uint32_t sinkBytes;  // discarded by rpcMessage::DataSink
+
+	void* Alloc(uint32_t size);
+	bool Owns(const void *p);
+	void Reset() { fill = 0; }
+	void ResetStat();
+};
+
+extern CRpcArena rpc_arena;
+
+
 
 
 struct rpcMsgData
@@ -108,7 +188,16 @@ public:
 	bool RecvDat();
 	bool RecvString(string &x);
 
-	void Flush() { io->Flush(); }
+	void Flush()
+	{
+		if (rpc_batch.active) { rpc_batch.replies++; io->Commit(); }
+		else
+		{
+			uint32_t start = Time_clk();
+			io->Flush();
+			rpc_profile.flush += Time_clk() - start;
+		}
+	}
 
 	void DataSink(uint32_t size);
 };
@@ -135,13 +224,19 @@ bool rpc_RecvVector(rpcMessage &msg, vector<T> &x)
 {
 	if (!msg.RecvDat()) return false;
 	uint32_t size = msg.GetDatSize();
-	if ((size % sizeof(T)) != 0)
+	if ((size % sizeof(T)) != 0 || size > RPC_RECV_MAX)
 	{
 		msg.DataSink(size);
 		THROW(WRONG_DATA_SIZE);
 	}
-	x.assign(size/sizeof(T), 0);
-	if (!msg.GetIo().Read(&(x[0]), size)) THROW(TIMEOUT)
+	// One bulk read into the vector. The storage is zero filled by resize
+	// (value initialization of std::vector), the RPC functions take
+	// vector<T> so it cannot be left uninitialized.
+	x.clear();
+	rpc_arena.active = true;
+	x.resize(size/sizeof(T));
+	rpc_arena.active = false;
+	if (size) if (!msg.GetIo().Read(&(x[0]), size)) THROW(TIMEOUT)
 	RETURN_OK
 }
 
@@ -1655,7 +1655,497 @@ bool rpc__GetADC$SC(rpcMessage &msg)
 	return true;
 }
 
-const uint16_t rpc_cmdListSize = 154;
+bool rpc__Daq_StreamStart$bCIS(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(7)) return false;
+	uint8_t rpc_par1 = msg.Get_UINT8();
+	uint32_t rpc_par2 = msg.Get_UINT32();
+	uint16_t rpc_par3 = msg.Get_UINT16();
+	bool rpc_par0 = tb.Daq_StreamStart(rpc_par1,rpc_par2,rpc_par3);
+	msg.CreateCmd(154);
+	msg.Put_BOOL(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Daq_StreamCredit$vS(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(2)) return false;
+	uint16_t rpc_par1 = msg.Get_UINT16();
+	tb.Daq_StreamCredit(rpc_par1);
+	return true;
+}
+
+bool rpc__Daq_StreamStop$I0I0I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(8)) return false;
+	uint32_t rpc_par1 = msg.Get_UINT32();
+	uint32_t rpc_par2 = msg.Get_UINT32();
+	uint32_t rpc_par0 = tb.Daq_StreamStop(rpc_par1,rpc_par2);
+	msg.CreateCmd(156);
+	msg.Put_UINT32(rpc_par0);
+	msg.Put_UINT32(rpc_par1);
+	msg.Put_UINT32(rpc_par2);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Daq_ReadAll$C5SIC(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(5)) return false;
+	uint32_t rpc_par2 = msg.Get_UINT32();
+	uint8_t rpc_par3 = msg.Get_UINT8();
+	uint32_t rpc_par1_hdr;
+	HWvectorR<uint16_t> rpc_par1;
+	uint8_t rpc_par0 = tb.Daq_ReadAll(rpc_par1,rpc_par2,rpc_par3);
+	msg.CreateCmd(157);
+	msg.Put_UINT8(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	rpc_par1.Write(msg, rpc_par1_hdr);
+	msg.Flush();
+	return true;
+}
+
+bool rpc__RpcBatchBegin$v(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	tb.RpcBatchBegin();
+	return true;
+}
+
+bool rpc__RpcBatchEnd$S(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	uint16_t rpc_par0 = tb.RpcBatchEnd();
+	msg.CreateCmd(159);
+	msg.Put_UINT16(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__GetRpcCallNames$v4c(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	uint32_t rpc_par1_hdr;
+	stringR rpc_par1;
+	tb.GetRpcCallNames(rpc_par1);
+	msg.CreateCmd(160);
+	if (!msg.SendCmd()) return false;
+	if (!msg.SendString(rpc_par1_hdr, rpc_par1)) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Daq_MapStart$bCCS(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(4)) return false;
+	uint8_t rpc_par1 = msg.Get_UINT8();
+	uint8_t rpc_par2 = msg.Get_UINT8();
+	uint16_t rpc_par3 = msg.Get_UINT16();
+	bool rpc_par0 = tb.Daq_MapStart(rpc_par1,rpc_par2,rpc_par3);
+	msg.CreateCmd(161);
+	msg.Put_BOOL(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Daq_MapStop$I0I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(4)) return false;
+	uint32_t rpc_par1 = msg.Get_UINT32();
+	uint32_t rpc_par0 = tb.Daq_MapStop(rpc_par1);
+	msg.CreateCmd(162);
+	msg.Put_UINT32(rpc_par0);
+	msg.Put_UINT32(rpc_par1);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Daq_MapGetHits$v5S(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	uint32_t rpc_par1_hdr;
+	HWvectorR<uint16_t> rpc_par1;
+	tb.Daq_MapGetHits(rpc_par1);
+	msg.CreateCmd(163);
+	if (!msg.SendCmd()) return false;
+	rpc_par1.Write(msg, rpc_par1_hdr);
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Daq_MapGetPhSum$vC2I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(1)) return false;
+	uint8_t rpc_par1 = msg.Get_UINT8();
+	uint32_t rpc_par2_hdr;
+	vectorR<uint32_t> rpc_par2;
+	tb.Daq_MapGetPhSum(rpc_par1,rpc_par2);
+	msg.CreateCmd(164);
+	if (!msg.SendCmd()) return false;
+	if (!rpc_SendVector(msg, rpc_par2_hdr, rpc_par2)) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Daq_MapSetBin$vSS(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(4)) return false;
+	uint16_t rpc_par1 = msg.Get_UINT16();
+	uint16_t rpc_par2 = msg.Get_UINT16();
+	tb.Daq_MapSetBin(rpc_par1,rpc_par2);
+	return true;
+}
+
+bool rpc__Daq_MapGetEff$vC2C(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(1)) return false;
+	uint8_t rpc_par1 = msg.Get_UINT8();
+	uint32_t rpc_par2_hdr;
+	vectorR<uint8_t> rpc_par2;
+	tb.Daq_MapGetEff(rpc_par1,rpc_par2);
+	msg.CreateCmd(166);
+	if (!msg.SendCmd()) return false;
+	if (!rpc_SendVector(msg, rpc_par2_hdr, rpc_par2)) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Daq_MapGetThreshold$vCC2S(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(2)) return false;
+	uint8_t rpc_par1 = msg.Get_UINT8();
+	uint8_t rpc_par2 = msg.Get_UINT8();
+	uint32_t rpc_par3_hdr;
+	vectorR<uint16_t> rpc_par3;
+	tb.Daq_MapGetThreshold(rpc_par1,rpc_par2,rpc_par3);
+	msg.CreateCmd(167);
+	if (!msg.SendCmd()) return false;
+	if (!rpc_SendVector(msg, rpc_par3_hdr, rpc_par3)) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__SetFindLevelMode$vC(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(1)) return false;
+	uint8_t rpc_par1 = msg.Get_UINT8();
+	tb.SetFindLevelMode(rpc_par1);
+	return true;
+}
+
+bool rpc__GetFindLevelSteps$Ib(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(1)) return false;
+	bool rpc_par1 = msg.Get_BOOL();
+	uint32_t rpc_par0 = tb.GetFindLevelSteps(rpc_par1);
+	msg.CreateCmd(169);
+	msg.Put_UINT32(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__roc_Chip_Mask_Time$I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	uint32_t rpc_par0 = tb.roc_Chip_Mask_Time();
+	msg.CreateCmd(170);
+	msg.Put_UINT32(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__roc_ShadowInvalidate$v(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	tb.roc_ShadowInvalidate();
+	return true;
+}
+
+bool rpc__roc_ShadowStat$I0I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(4)) return false;
+	uint32_t rpc_par1 = msg.Get_UINT32();
+	uint32_t rpc_par0 = tb.roc_ShadowStat(rpc_par1);
+	msg.CreateCmd(172);
+	msg.Put_UINT32(rpc_par0);
+	msg.Put_UINT32(rpc_par1);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__LoopGetResumeStat$I0I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(4)) return false;
+	uint32_t rpc_par1 = msg.Get_UINT32();
+	uint32_t rpc_par0 = tb.LoopGetResumeStat(rpc_par1);
+	msg.CreateCmd(173);
+	msg.Put_UINT32(rpc_par0);
+	msg.Put_UINT32(rpc_par1);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Scan_Set$b1CSS(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(4)) return false;
+	uint16_t rpc_par2 = msg.Get_UINT16();
+	uint16_t rpc_par3 = msg.Get_UINT16();
+	vector<uint8_t> rpc_par1; if (!rpc_RecvVector(msg, rpc_par1)) return false;
+	bool rpc_par0 = tb.Scan_Set(rpc_par1,rpc_par2,rpc_par3);
+	msg.CreateCmd(174);
+	msg.Put_BOOL(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Scan_SetPixels$b1S(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	vector<uint16_t> rpc_par1; if (!rpc_RecvVector(msg, rpc_par1)) return false;
+	bool rpc_par0 = tb.Scan_SetPixels(rpc_par1);
+	msg.CreateCmd(175);
+	msg.Put_BOOL(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Scan_AddAxis$bCCSSS(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(8)) return false;
+	uint8_t rpc_par1 = msg.Get_UINT8();
+	uint8_t rpc_par2 = msg.Get_UINT8();
+	uint16_t rpc_par3 = msg.Get_UINT16();
+	uint16_t rpc_par4 = msg.Get_UINT16();
+	uint16_t rpc_par5 = msg.Get_UINT16();
+	bool rpc_par0 = tb.Scan_AddAxis(rpc_par1,rpc_par2,rpc_par3,rpc_par4,rpc_par5);
+	msg.CreateCmd(176);
+	msg.Put_BOOL(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Scan_Run$b(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	bool rpc_par0 = tb.Scan_Run();
+	msg.CreateCmd(177);
+	msg.Put_BOOL(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__GetMinTriggerSpacing$S(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	uint16_t rpc_par0 = tb.GetMinTriggerSpacing();
+	msg.CreateCmd(178);
+	msg.Put_UINT16(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__SetLoopTriggerMode$vC(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(1)) return false;
+	uint8_t rpc_par1 = msg.Get_UINT8();
+	tb.SetLoopTriggerMode(rpc_par1);
+	return true;
+}
+
+bool rpc__GetLoopTriggerStat$I0I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(4)) return false;
+	uint32_t rpc_par1 = msg.Get_UINT32();
+	uint32_t rpc_par0 = tb.GetLoopTriggerStat(rpc_par1);
+	msg.CreateCmd(180);
+	msg.Put_UINT32(rpc_par0);
+	msg.Put_UINT32(rpc_par1);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Bench_Upload$I1S(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	vector<uint16_t> rpc_par1; if (!rpc_RecvVector(msg, rpc_par1)) return false;
+	uint32_t rpc_par0 = tb.Bench_Upload(rpc_par1);
+	msg.CreateCmd(181);
+	msg.Put_UINT32(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Bench_Download$vI5S(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(4)) return false;
+	uint32_t rpc_par1 = msg.Get_UINT32();
+	uint32_t rpc_par2_hdr;
+	HWvectorR<uint16_t> rpc_par2;
+	tb.Bench_Download(rpc_par1,rpc_par2);
+	msg.CreateCmd(182);
+	if (!msg.SendCmd()) return false;
+	rpc_par2.Write(msg, rpc_par2_hdr);
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Scan_GetStat$I0I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(4)) return false;
+	uint32_t rpc_par1 = msg.Get_UINT32();
+	uint32_t rpc_par0 = tb.Scan_GetStat(rpc_par1);
+	msg.CreateCmd(183);
+	msg.Put_UINT32(rpc_par0);
+	msg.Put_UINT32(rpc_par1);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__RpcProfileGet$I2I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	uint32_t rpc_par1_hdr;
+	vectorR<uint32_t> rpc_par1;
+	uint32_t rpc_par0 = tb.RpcProfileGet(rpc_par1);
+	msg.CreateCmd(184);
+	msg.Put_UINT32(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	if (!rpc_SendVector(msg, rpc_par1_hdr, rpc_par1)) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__RpcProfileReset$v(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(0)) return false;
+	tb.RpcProfileReset();
+	return true;
+}
+
+bool rpc__Ethernet_GetStat$I0I0I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(8)) return false;
+	uint32_t rpc_par1 = msg.Get_UINT32();
+	uint32_t rpc_par2 = msg.Get_UINT32();
+	uint32_t rpc_par0 = tb.Ethernet_GetStat(rpc_par1,rpc_par2);
+	msg.CreateCmd(186);
+	msg.Put_UINT32(rpc_par0);
+	msg.Put_UINT32(rpc_par1);
+	msg.Put_UINT32(rpc_par2);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__GetRpcAllocStat$v2Ib(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(1)) return false;
+	bool rpc_par2 = msg.Get_BOOL();
+	uint32_t rpc_par1_hdr;
+	vectorR<uint32_t> rpc_par1;
+	tb.GetRpcAllocStat(rpc_par1,rpc_par2);
+	msg.CreateCmd(187);
+	if (!msg.SendCmd()) return false;
+	if (!rpc_SendVector(msg, rpc_par1_hdr, rpc_par1)) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Daq_GetFreeMem$I0I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(4)) return false;
+	uint32_t rpc_par1 = msg.Get_UINT32();
+	uint32_t rpc_par0 = tb.Daq_GetFreeMem(rpc_par1);
+	msg.CreateCmd(188);
+	msg.Put_UINT32(rpc_par0);
+	msg.Put_UINT32(rpc_par1);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__SetPixelAddressInverted$vb(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(1)) return false;
+	bool rpc_par1 = msg.Get_BOOL();
+	tb.SetPixelAddressInverted(rpc_par1);
+	return true;
+}
+
+bool rpc__Daq_MapGetStat$I0I(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(4)) return false;
+	uint32_t rpc_par1 = msg.Get_UINT32();
+	uint32_t rpc_par0 = tb.Daq_MapGetStat(rpc_par1);
+	msg.CreateCmd(190);
+	msg.Put_UINT32(rpc_par0);
+	msg.Put_UINT32(rpc_par1);
+	if (!msg.SendCmd()) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Daq_Read$C2SIC(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(5)) return false;
+	uint32_t rpc_par2 = msg.Get_UINT32();
+	uint8_t rpc_par3 = msg.Get_UINT8();
+	uint32_t rpc_par1_hdr;
+	vectorR<uint16_t> rpc_par1;
+	uint8_t rpc_par0 = tb.Daq_Read(rpc_par1,rpc_par2,rpc_par3);
+	msg.CreateCmd(191);
+	msg.Put_UINT8(rpc_par0);
+	if (!msg.SendCmd()) return false;
+	if (!rpc_SendVector(msg, rpc_par1_hdr, rpc_par1)) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Daq_Read$C2SI0IC(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(9)) return false;
+	uint32_t rpc_par2 = msg.Get_UINT32();
+	uint32_t rpc_par3 = msg.Get_UINT32();
+	uint8_t rpc_par4 = msg.Get_UINT8();
+	uint32_t rpc_par1_hdr;
+	vectorR<uint16_t> rpc_par1;
+	uint8_t rpc_par0 = tb.Daq_Read(rpc_par1,rpc_par2,rpc_par3,rpc_par4);
+	msg.CreateCmd(192);
+	msg.Put_UINT8(rpc_par0);
+	msg.Put_UINT32(rpc_par3);
+	if (!msg.SendCmd()) return false;
+	if (!rpc_SendVector(msg, rpc_par1_hdr, rpc_par1)) return false;
+	msg.Flush();
+	return true;
+}
+
+bool rpc__Bench_UsbBytewise$vb(rpcMessage &msg)
+{
+	if (!msg.CheckCmdSize(1)) return false;
+	bool rpc_par1 = msg.Get_BOOL();
+	tb.Bench_UsbBytewise(rpc_par1);
+	return true;
+}
+
+const uint16_t rpc_cmdListSize = 194;
 
 const CRpcCall rpc_cmdlist[] =
 {
@@ -1812,21 +2302,79 @@ const CRpcCall rpc_cmdlist[] =
 	/*   150 */ { rpc__LoopSingleRocOnePixelDacDacScan$bCCCSSCCCCCC, "LoopSingleRocOnePixelDacDacScan$bCCCSSCCCCCC" },
 	/*   151 */ { rpc__LoopSingleRocOnePixelDacDacScan$bCCCSSCCCCCCCC, "LoopSingleRocOnePixelDacDacScan$bCCCSSCCCCCCCC" },
 	/*   152 */ { rpc__VectorTest$v1S2S, "VectorTest$v1S2S" },
-	/*   153 */ { rpc__GetADC$SC, "GetADC$SC" }
+	/*   153 */ { rpc__GetADC$SC, "GetADC$SC" },
+	/*   154 */ { rpc__Daq_StreamStart$bCIS, "Daq_StreamStart$bCIS" },
+	/*   155 */ { rpc__Daq_StreamCredit$vS, "Daq_StreamCredit$vS" },
+	/*   156 */ { rpc__Daq_StreamStop$I0I0I, "Daq_StreamStop$I0I0I" },
+	/*   157 */ { rpc__Daq_ReadAll$C5SIC, "Daq_ReadAll$C5SIC" },
+	/*   158 */ { rpc__RpcBatchBegin$v, "RpcBatchBegin$v" },
+	/*   159 */ { rpc__RpcBatchEnd$S, "RpcBatchEnd$S" },
+	/*   160 */ { rpc__GetRpcCallNames$v4c, "GetRpcCallNames$v4c" },
+	/*   161 */ { rpc__Daq_MapStart$bCCS, "Daq_MapStart$bCCS" },
+	/*   162 */ { rpc__Daq_MapStop$I0I, "Daq_MapStop$I0I" },
+	/*   163 */ { rpc__Daq_MapGetHits$v5S, "Daq_MapGetHits$v5S" },
+	/*   164 */ { rpc__Daq_MapGetPhSum$vC2I, "Daq_MapGetPhSum$vC2I" },
+	/*   165 */ { rpc__Daq_MapSetBin$vSS, "Daq_MapSetBin$vSS" },
+	/*   166 */ { rpc__Daq_MapGetEff$vC2C, "Daq_MapGetEff$vC2C" },
+	/*   167 */ { rpc__Daq_MapGetThreshold$vCC2S, "Daq_MapGetThreshold$vCC2S" },
+	/*   168 */ { rpc__SetFindLevelMode$vC, "SetFindLevelMode$vC" },
+	/*   169 */ { rpc__GetFindLevelSteps$Ib, "GetFindLevelSteps$Ib" },
+	/*   170 */ { rpc__roc_Chip_Mask_Time$I, "roc_Chip_Mask_Time$I" },
+	/*   171 */ { rpc__roc_ShadowInvalidate$v, "roc_ShadowInvalidate$v" },
+	/*   172 */ { rpc__roc_ShadowStat$I0I, "roc_ShadowStat$I0I" },
+	/*   173 */ { rpc__LoopGetResumeStat$I0I, "LoopGetResumeStat$I0I" },
+	/*   174 */ { rpc__Scan_Set$b1CSS, "Scan_Set$b1CSS" },
+	/*   175 */ { rpc__Scan_SetPixels$b1S, "Scan_SetPixels$b1S" },
+	/*   176 */ { rpc__Scan_AddAxis$bCCSSS, "Scan_AddAxis$bCCSSS" },
+	/*   177 */ { rpc__Scan_Run$b, "Scan_Run$b" },
+	/*   178 */ { rpc__GetMinTriggerSpacing$S, "GetMinTriggerSpacing$S" },
+	/*   179 */ { rpc__SetLoopTriggerMode$vC, "SetLoopTriggerMode$vC" },
+	/*   180 */ { rpc__GetLoopTriggerStat$I0I, "GetLoopTriggerStat$I0I" },
+	/*   181 */ { rpc__Bench_Upload$I1S, "Bench_Upload$I1S" },
+	/*   182 */ { rpc__Bench_Download$vI5S, "Bench_Download$vI5S" },
+	/*   183 */ { rpc__Scan_GetStat$I0I, "Scan_GetStat$I0I" },
+	/*   184 */ { rpc__RpcProfileGet$I2I, "RpcProfileGet$I2I" },
+	/*   185 */ { rpc__RpcProfileReset$v, "RpcProfileReset$v" },
+	/*   186 */ { rpc__Ethernet_GetStat$I0I0I, "Ethernet_GetStat$I0I0I" },
+	/*   187 */ { rpc__GetRpcAllocStat$v2Ib, "GetRpcAllocStat$v2Ib" },
+	/*   188 */ { rpc__Daq_GetFreeMem$I0I, "Daq_GetFreeMem$I0I" },
+	/*   189 */ { rpc__SetPixelAddressInverted$vb, "SetPixelAddressInverted$vb" },
+	/*   190 */ { rpc__Daq_MapGetStat$I0I, "Daq_MapGetStat$I0I" },
+	/*   191 */ { rpc__Daq_Read$C2SIC, "Daq_Read$C2SIC" },
+	/*   192 */ { rpc__Daq_Read$C2SI0IC, "Daq_Read$C2SI0IC" },
+	/*   193 */ { rpc__Bench_UsbBytewise$vb, "Bench_UsbBytewise$vb" }
 };
 
 void rpc_Dispatcher(CRpcIo &rpc_io)
 {
 	rpcMessage msg;
 	msg.SetIo(rpc_io);
+	rpc_profile.Reset();
 	while (true)
 	{
+		// push DAQ stream data while no command is pending
+		if (!rpc_batch.active && tb.Daq_StreamService() && !msg.GetIo().RxFull()) continue;
+
+		// serve the interface a command arrives on
+		msg.SetIo(*tb.RpcIoSelect());
+		if (!msg.GetIo().RxFull()) continue;
+
 		if (msg.RecvCmd())
 		{
 			uint16_t cmd = msg.GetCmd();
 			if (rpc_error.HasError()) continue;
-			if (cmd >= 154) continue;
-			if (!rpc_cmdlist[cmd].call(msg)) msg.GetIo().Reset();
+			if (cmd >= 194) continue;
+			uint32_t flush = rpc_profile.flush;
+			uint32_t start = Time_clk();
+			bool ok = rpc_cmdlist[cmd].call(msg);
+			rpc_profile.Add(cmd, Time_clk() - start, rpc_profile.flush - flush);
+			rpc_arena.Reset();
+			if (!ok)
+			{ // discard reply (and deferred replies of a batch)
+				msg.GetIo().Reset();
+				rpc_batch.End();
+			}
+			tb.I2cFence(); // keep host side ordering of ROC commands
 		}
 	}
 }
@@ -13,5 +13,10 @@ public:
 	virtual bool RxFull() = 0;
 	virtual bool Write(const void *buffer, unsigned int size) = 0;
 	virtual void Flush() = 0;
+	// flush without waiting; buffers must stay valid while TxBusy()
+	virtual void FlushAsync() { Flush(); }
+	virtual bool TxBusy() { return false; }
+	// release caller buffers, small data may stay queued for the next Flush
+	virtual void Commit() { Flush(); }
 	virtual bool Read(void *buffer, unsigned int size) = 0;
 };
@@ -0,0 +1,268 @@
+// scan.cc
+// Generic scan engine: one executor for all calibrate, DAC and DAC-DAC
+// scans. The host uploads a descriptor (ROCs, pixel set, axes) and calls
+// Scan_Run until it returns true. Scan_Run returns false if the DAQ
+// buffers are filled, the next call resumes at the interrupted point.
+// A descriptor with a failed Scan_Set/Scan_SetPixels/Scan_AddAxis call
+// is invalid and Scan_Run returns false without sending triggers.
+
+#include "pixel_dtb.h"
+
+#define LOOP_MAX_INTERRUPTS 150
+
+// Wait this long when setting DACs to lowest value
+// they need time to settle after large jumps. Time given in usec.
+#define LOOP_SETDAC_DELAY_LONG uDelay(70)
+#define LOOP_SETDAC_DELAY_SHORT uDelay(0)
+
+
+bool CTestboard::ScanSetRocs(const uint8_t *roc_i2c, uint8_t nrocs, uint16_t nTriggers, uint16_t flags)
+{
+	scan.valid = false;
+	scan.id = 0x5ca9;
+	scan.nrocs = 0;
+	scan.npixels = 0;
+	scan.naxes = 0;
+	// the position is kept for a resume, Scan_Run rewinds a new scan
+	if (nrocs > SCAN_MAXROCS) return false;
+
+	scan.nTriggers = nTriggers;
+	scan.flags = flags;
+	scan.Hash(nTriggers);
+	scan.Hash(flags);
+
+	// lookup the trim values of each ROC once
+	for (uint8_t i = 0; i < nrocs; i++)
+	{
+		uint8_t index;
+		for (index = 0; index < MOD_NUMROCS; index++)
+			if (ROC_I2C_ADDRESSES[index] == roc_i2c[i]) break;
+		scan.roc[i] = roc_i2c[i];
+		scan.trim[i] = (index < MOD_NUMROCS) ? index : SCAN_NOTRIM;
+		scan.Hash(roc_i2c[i]);
+	}
+	scan.nrocs = nrocs;
+
+	// default: all pixels
+	for (uint8_t col = 0; col < ROC_NUMCOLS; col++)
+		for (uint8_t row = 0; row < ROC_NUMROWS; row++)
+			scan.pixel[scan.npixels++] = (col << 8) + row;
+	scan.Hash(scan.npixels);
+
+	scan.valid = true;
+	return true;
+}
+
+
+bool CTestboard::ScanSetPixel(uint8_t column, uint8_t row)
+{
+	if (column >= ROC_NUMCOLS || row >= ROC_NUMROWS) { scan.valid = false; return false; }
+	scan.pixel[0] = (column << 8) + row;
+	scan.npixels = 1;
+	scan.Hash(scan.pixel[0]);
+	return true;
+}
+
+
+bool CTestboard::Scan_Set(vector<uint8_t> &roc_i2c, uint16_t nTriggers, uint16_t flags)
+{
+	if (roc_i2c.size() > SCAN_MAXROCS) { scan.valid = false; return false; }
+	return ScanSetRocs(roc_i2c.empty() ? 0 : &roc_i2c[0], roc_i2c.size(), nTriggers, flags);
+}
+
+
+bool CTestboard::Scan_SetPixels(vector<uint16_t> &pixels)
+{
+	if (pixels.size() > SCAN_MAXPIXELS) { scan.valid = false; return false; }
+	scan.npixels = 0;
+	for (size_t i = 0; i < pixels.size(); i++)
+	{
+		uint16_t p = pixels[i];
+		if ((p >> 8) >= ROC_NUMCOLS || (p & 0xff) >= ROC_NUMROWS) { scan.valid = false; return false; }
+		scan.pixel[scan.npixels++] = p;
+		scan.Hash(p);
+	}
+	scan.Hash(scan.npixels);
+	return true;
+}
+
+
+bool CTestboard::Scan_AddAxis(uint8_t type, uint8_t reg, uint16_t low, uint16_t high, uint16_t step)
+{
+	if (scan.naxes >= SCAN_MAXAXES || type > SCAN_VD
+		|| step == 0 || high < low || (high - low)/step >= SCAN_MAXSTEPS
+		|| (type == SCAN_ROCDAC && high > 255)) { scan.valid = false; return false; }
+
+	CScanAxis &x = scan.axis[scan.naxes];
+	x.type = type;
+	x.reg = reg;
+	x.n = (high - low)/step + 1;
+	for (uint16_t i = 0; i < x.n; i++)
+	{
+		uint16_t value = low + i*step;
+		if (type == SCAN_ROCDAC && !(scan.flags & FLAG_DISABLE_DACCAL))
+			value = CalibratedDAC(reg, value);
+		x.value[i] = value;
+	}
+	scan.naxes++;
+
+	scan.Hash((type << 8) + reg);
+	scan.Hash(low);
+	scan.Hash(high);
+	scan.Hash(step);
+	return true;
+}
+
+
+// Enables (trim, calibrate) or disables the current pixel on all ROCs.
+// The column is disabled after its last pixel.
+void CTestboard::ScanPixel(bool on)
+{
+	uint8_t col = scan.pixel[scan.pos] >> 8;
+	uint8_t row = scan.pixel[scan.pos] & 0xff;
+	bool masked = !(scan.flags & FLAG_FORCE_UNMASKED);
+	bool lastInCol = scan.pos + 1 >= scan.npixels || (scan.pixel[scan.pos + 1] >> 8) != col;
+
+	for (uint8_t i = 0; i < scan.nrocs; i++)
+	{
+		roc_I2cAddr(scan.roc[i]);
+		if (on)
+		{
+			if (masked)
+			{
+				roc_Col_Enable(col, true);
+				// trim values > 15: pixel stays masked
+				uint8_t value = 0xff;
+				if (scan.trim[i] != SCAN_NOTRIM)
+					value = ROC_TRIM_BITS[scan.trim[i]*ROC_NUMROWS*ROC_NUMCOLS + col*ROC_NUMROWS + row];
+				if (value < 16) roc_Pix_Trim(col, row, value);
+				cDelay(LoopTrimDelay);
+			}
+			roc_Pix_Cal(col, GetXtalkRow(row, (scan.flags & FLAG_XTALK)), (scan.flags & FLAG_CALS));
+		}
+		else
+		{
+			if (masked) roc_Pix_Mask(col, row);
+			roc_ClrCal();
+			if (masked && lastInCol) roc_Col_Enable(col, false);
+		}
+	}
+}
+
+
+void CTestboard::ScanSetAxis(uint8_t a)
+{
+	CScanAxis &x = scan.axis[a];
+	uint16_t value = x.value[scan.step[a]];
+	switch (x.type)
+	{
+	case SCAN_ROCDAC:
+		for (uint8_t i = 0; i < scan.nrocs; i++)
+		{
+			roc_I2cAddr(scan.roc[i]);
+			roc_SetDAC(x.reg, value);
+		}
+		break;
+	case SCAN_SIGDELAY:   Sig_SetDelay(x.reg, value); break;
+	case SCAN_DESERPHASE: Deser400_SetPhase(x.reg, value); break;
+	case SCAN_VA:         _SetVA(value); break;
+	case SCAN_VD:         _SetVD(value); break;
+	}
+}
+
+
+bool CTestboard::Scan_Run()
+{
+	if (!scan.valid) return false; // rejected descriptor, no triggers sent
+
+	const uint16_t TriggerDelay = GetLoopTriggerDelay(scan.nTriggers);
+	bool masked = !(scan.flags & FLAG_FORCE_UNMASKED);
+
+	// Check if we resume a previous scan:
+	bool keep;
+	if (!LoopInterruptResume(scan.id, keep)) scan.Rewind();
+	uint32_t start = Time_us();
+
+	// A resumed scan finds the ROCs in the state it left them, skip the preamble:
+	uint32_t preamble = Time_us();
+	if (!keep)
+	{
+		for (uint8_t i = 0; i < scan.nrocs; i++)
+		{
+			roc_I2cAddr(scan.roc[i]);
+			// If FLAG_FORCE_UNMASKED is not set, mask the chip,
+			// otherwise attach all columns:
+			if (masked) roc_Chip_Mask(); else roc_AllCol_Enable(true);
+		}
+		LoopPreambleDone(preamble);
+	}
+
+	// Loop over the pixels (a single pass without pixels if none is set):
+	uint16_t npixels = scan.npixels ? scan.npixels : 1;
+	for (; scan.pos < npixels; scan.pos++)
+	{
+		if (scan.npixels) ScanPixel(true);
+
+		// Loop over all points of the axes, set all axes at the first one:
+		uint8_t first = 0;
+		do
+		{
+			// Return true if we had too many retrys:
+			if (LoopInterruptCounter >= LOOP_MAX_INTERRUPTS)
+			{
+				LoopInterruptReset();
+				scan.time += Time_us() - start;
+				return true;
+			}
+			// Interrupt the scan in case of high buffer fill level:
+			else if (!LoopInterruptStatus())
+			{
+				LoopInterruptStore(scan.id);
+				scan.time += Time_us() - start;
+				return false;
+			}
+
+			for (uint8_t a = first; a < scan.naxes; a++) ScanSetAxis(a);
+
+			// Give the DACs time to settle:
+			if (scan.naxes)
+			{
+				if (scan.step[scan.naxes - 1] == 0) LOOP_SETDAC_DELAY_LONG;
+				else { LOOP_SETDAC_DELAY_SHORT; }
+			}
+
+			// Select the efficiency bin in pixel map mode:
+			uint32_t bin = scan.Bin();
+			Daq_MapSetBin(bin < 0xffff ? bin : 0xffff, scan.nTriggers);
+
+			// Send the triggers, fixed delay or paced by the readout:
+			for (uint16_t trig = 0; trig < scan.nTriggers; trig++)
+				LoopTrigger(TriggerDelay);
+			scan.points++;
+		} while (scan.Next(first));
+
+		if (scan.npixels) ScanPixel(false);
+	}
+
+	// If FLAG_FORCE_UNMASKED is set detach all columns:
+	if (!masked)
+	{
+		for (uint8_t i = 0; i < scan.nrocs; i++)
+		{
+			roc_I2cAddr(scan.roc[i]);
+			roc_AllCol_Enable(false);
+		}
+	}
+
+	// Reached the end of the scan:
+	LoopInterruptReset();
+	scan.time += Time_us() - start;
+	return true;
+}
+
+
+uint32_t CTestboard::Scan_GetStat(uint32_t &points)
+{
+	points = scan.points;
+	return scan.time;
+}
@@ -0,0 +1,88 @@
+// scan.h
+// Descriptor of a generic calibrate scan (CTestboard::Scan_Run).
+// A scan loops over a pixel set (outermost loop) and up to SCAN_MAXAXES
+// nested parameter axes (first axis = outer loop) and sends nTriggers
+// triggers at each point. The values of an axis are computed once when
+// the axis is added. The scan position is the checkpoint of an
+// interrupted scan.
+
+#pragma once
+
+#include "cstdint.h"
+
+
+#define SCAN_MAXROCS    16
+#define SCAN_MAXPIXELS  4160  // ROC_NUMCOLS*ROC_NUMROWS
+#define SCAN_MAXAXES    4
+#define SCAN_MAXSTEPS   256
+#define SCAN_NOTRIM     0xff  // no trim values uploaded for this ROC
+
+// axis types (reg = parameter of the set function)
+#define SCAN_ROCDAC     0  // roc_SetDAC(reg, value) on all ROCs
+#define SCAN_SIGDELAY   1  // Sig_SetDelay(reg, value)
+#define SCAN_DESERPHASE 2  // Deser400_SetPhase(reg, value)
+#define SCAN_VA         3  // _SetVA(value)
+#define SCAN_VD         4  // _SetVD(value)
+
+
+struct CScanAxis
+{
+	uint8_t  type;
+	uint8_t  reg;
+	uint16_t n;                     // number of steps
+	uint16_t value[SCAN_MAXSTEPS];  // value set at each step
+};
+
+
+struct CScan
+{
+	bool     valid;
+	uint16_t id;        // hash of the descriptor, identifies an interrupted scan
+	uint8_t  nrocs;
+	uint8_t  roc[SCAN_MAXROCS];   // I2C address
+	uint8_t  trim[SCAN_MAXROCS];  // index in ROC_TRIM_BITS or SCAN_NOTRIM
+	uint16_t nTriggers;
+	uint16_t flags;
+	uint16_t npixels;   // 0 = no pixel is enabled
+	uint16_t pixel[SCAN_MAXPIXELS];  // (column << 8) + row
+	uint8_t  naxes;
+	CScanAxis axis[SCAN_MAXAXES];
+
+	// scan position
+	uint16_t pos;       // pixel index
+	uint16_t step[SCAN_MAXAXES];
+
+	// cost of the scan, summed over resumed runs
+	uint32_t time;      // us in Scan_Run
+	uint32_t points;    // points done (pixel x axes steps)
+
+	void Hash(uint16_t x) { id = ((id << 5) | (id >> 11)) ^ x; }
+	void Rewind()
+	{
+		pos = 0;
+		for (uint8_t a = 0; a < SCAN_MAXAXES; a++) step[a] = 0;
+		time = 0;
+		points = 0;
+	}
+
+	// Steps to the next point. Returns false after the last point of a
+	// pixel (all axes back at step 0), first = outermost axis changed.
+	bool Next(uint8_t &first)
+	{
+		for (first = naxes; first > 0; )
+		{
+			first--;
+			if (++step[first] < axis[first].n) return true;
+			step[first] = 0;
+		}
+		return false;
+	}
+
+	// flattened step index (efficiency bin in pixel map mode)
+	uint32_t Bin()
+	{
+		uint32_t bin = 0;
+		for (uint8_t a = 0; a < naxes; a++) bin = bin*axis[a].n + step[a];
+		return bin;
+	}
+};
@@ -1,30 +1,54 @@
 // sgdma.cc
 
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include "sgdma.h"
+#include "altera_avalon_sgdma_regs.h"
+#include "io.h"
 #include "sys/alt_cache.h"
+#include "sys/alt_irq.h"
 
 
-#define SGDMA_NDESCRIPTORS DESCRIPTOR_MEMORY_SIZE_VALUE/32 - 4
+// writes up to this size are copied into a staging buffer
+#define SGDMA_COPY_LIMIT  512
+#define SGDMA_STAGE_SIZE 2048
 
 // descriptors in descriptor_memory
 alt_sgdma_descriptor descriptor[SGDMA_NDESCRIPTORS] __attribute__ (( section ( ".descriptor_memory" )));
 
+// staging buffer for each descriptor
+static uint8_t stage_buffer[SGDMA_NDESCRIPTORS][SGDMA_STAGE_SIZE] __attribute__ (( aligned (32) ));
+
 
 CDma::CDma()
 {
+	handler = 0;
+	handlerContext = 0;
+	active = notify = false;
+	activeSize = 0;
+	activeLast = 0;
+
 	device = alt_avalon_sgdma_open("/dev/usb_tx_dma");
-	DeleteAllDescriptors();
+	if (device) alt_avalon_sgdma_register_callback(device, Irq,
+		ALTERA_AVALON_SGDMA_CONTROL_IE_GLOBAL_MSK |
+		ALTERA_AVALON_SGDMA_CONTROL_IE_CHAIN_COMPLETED_MSK, this);
+
+	head = 0;
+	nFree = SGDMA_NDESCRIPTORS;
+	NewChain();
 }
 
 
 alt_sgdma_descriptor* CDma::CreateDescriptor()
 {
-	if (pos >= SGDMA_NDESCRIPTORS) return 0;
+	if (nFree <= 0) return 0;
 
-	// create new descriptor
-	alt_sgdma_descriptor *descr = descriptor + pos;
-	pos++;
+	// take next descriptor from ring
+	alt_sgdma_descriptor *descr = descriptor + head;
+	if (++head >= SGDMA_NDESCRIPTORS) head = 0;
+	nFree--;
+	chainSize++;
 
 	// initialize as end descriptor
 	descr->read_addr         = 0;
@@ -46,42 +70,152 @@ alt_sgdma_descriptor* CDma::CreateDescriptor()
 }
 
 
+void CDma::NewChain()
+{
+	chainStart = head;
+	chainSize = 0;
+	chainBorrowed = false;
+	stage = 0;
+	stageFill = 0;
+	if (nFree <= 0) Wait(); // all descriptors on the wire
+	last = CreateDescriptor();
+}
+
+
+void CDma::Irq(void *context)
+{
+	((CDma*)context)->Complete();
+}
+
+
+// called from interrupt or by polling; the active chain is finished
+// when hardware has released its last data descriptor
+void CDma::Complete()
+{
+	alt_irq_context cpu_sr = alt_irq_disable_all();
+	bool done = active && !(IORD_8DIRECT(&(activeLast->control), 0)
+		& ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_OWNED_BY_HW_MSK);
+	bool n = done && notify;
+	if (done) active = notify = false;
+	alt_irq_enable_all(cpu_sr);
+	if (n && handler) handler(handlerContext);
+}
+
+
+void CDma::Wait()
+{
+	while (active) Complete();
+
+	// release descriptors of finished chain
+	nFree += activeSize;
+	activeSize = 0;
+}
+
+
+void CDma::Launch(bool flush)
+{
+	Wait(); // only one chain on the wire
+
+	if (chainSize < 2)
+	{ // nothing to send
+		if (flush && handler) handler(handlerContext);
+		return;
+	}
+
+	// find last data descriptor (the one before the end descriptor)
+	int n = (last - descriptor) - 1;
+	if (n < 0) n += SGDMA_NDESCRIPTORS;
+
+	activeSize = chainSize;
+	activeLast = descriptor + n;
+	notify = flush;
+	active = true;
+
+	// the controller stays busy for the status write back after it has
+	// released the last descriptor of the previous chain: -EBUSY, retry
+	if (device)
+		while (alt_avalon_sgdma_do_async_transfer(device, descriptor + chainStart) == -EBUSY);
+	else active = false; // no device: the chain is released unsent
+
+	NewChain();
+}
+
+
+void CDma::Append(const void *buffer, uint16_t size, bool copy)
+{
+	if (nFree <= 0) Launch(false); // ring full: send chain under construction
+
+	// current end descriptor becomes data descriptor
+	alt_sgdma_descriptor *descr = last;
+	if (copy)
+	{
+		uint8_t *p = stage_buffer[descr - descriptor];
+		memcpy(p, buffer, size);
+		alt_dcache_flush(p, size);
+		buffer = p;
+		stage = descr;
+		stageFill = size;
+	}
+	else
+	{
+		stage = 0;
+		chainBorrowed = true;
+	}
+
+	// create new end descriptor
+	last = CreateDescriptor();
+
+	descr->read_addr         = (alt_u32 *) buffer;
+	descr->next              = (alt_u32 *) last;
+	descr->bytes_to_transfer = size;
+	descr->control =
+		ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_OWNED_BY_HW_MSK |
+		ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_WRITE_FIXED_ADDRESS_MSK | // SOP
+		ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_GENERATE_EOP_MSK;
+
+//	alt_remap_uncached(descr, sizeof(alt_sgdma_descriptor));
+	alt_dcache_flush(descr, sizeof(alt_sgdma_descriptor));
+}
+
+
 void CDma::DeleteAllDescriptors()
 {
-	pos = 0;
-	first = last = CreateDescriptor();
+	Wait();
+
+	// discard chain under construction
+	head = chainStart;
+	nFree += chainSize;
+	NewChain();
 }
 
 
 bool CDma::Add(const void *buffer, uint32_t byte_size)
 {
+	if (byte_size == 0) return true;
+
+	if (byte_size <= SGDMA_COPY_LIMIT)
+	{
+		if (stage && (stageFill + byte_size <= SGDMA_STAGE_SIZE))
+		{ // append to staging buffer of last data descriptor
+			uint8_t *p = stage_buffer[stage - descriptor] + stageFill;
+			memcpy(p, buffer, byte_size);
+			alt_dcache_flush(p, byte_size);
+			stageFill += byte_size;
+			stage->bytes_to_transfer = stageFill;
+			alt_dcache_flush(stage, sizeof(alt_sgdma_descriptor));
+		}
+		else Append(buffer, byte_size, true);
+		return true;
+	}
+
 //	alt_remap_uncached((void*)buffer, byte_size);
 	alt_dcache_flush((void*)buffer, byte_size);
 
 	while (byte_size)
 	{
-		uint16_t size = (byte_size > 0xfff8) ? 0xfff8 : byte_size;
+		uint16_t size = (byte_size > SGDMA_MAX_TRANSFER) ? SGDMA_MAX_TRANSFER : byte_size;
 		byte_size -= size;
-
-		// create new end descriptor
-		alt_sgdma_descriptor *endDescr = CreateDescriptor();
-		if (!endDescr)
-		{
-			Send();
-			endDescr = CreateDescriptor();
-		}
-
-		last->read_addr         = (alt_u32 *) buffer;
-		last->next              = (alt_u32 *) endDescr;
-		last->bytes_to_transfer = size;
-		last->control =
-			ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_OWNED_BY_HW_MSK |
-			ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_WRITE_FIXED_ADDRESS_MSK | // SOP
-			ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_GENERATE_EOP_MSK;
-
-//		alt_remap_uncached(last, sizeof(alt_sgdma_descriptor));
-		alt_dcache_flush(last, sizeof(alt_sgdma_descriptor));
-		last = endDescr;
+		Append(buffer, size, false);
 		buffer = ((alt_u8*)buffer) + size;
 	}
 	return true;
@@ -90,7 +224,7 @@ bool CDma::Add(const void *buffer, uint32_t byte_size)
 /*
 void CDma::DumpDescriptorChain()
 {
-	alt_sgdma_descriptor *p = first;
+	alt_sgdma_descriptor *p = descriptor + chainStart;
 	int cnt = 0;
 	while (p->control & ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_OWNED_BY_HW_MSK && cnt < 10)
 	{
@@ -106,8 +240,29 @@ void CDma::DumpDescriptorChain()
 */
 
 
+// release borrowed buffers: sends the whole chain, copied data included,
+// and waits for completion without calling the handler
+void CDma::Commit()
+{
+	if (!chainBorrowed) return;
+	Launch(false);
+	Wait();
+}
+
+
+// start transfer without waiting, the caller must keep borrowed
+// buffers valid until Busy() returns false
+void CDma::SendAsync()
+{
+	Launch(true);
+}
+
+
 void CDma::Send()
 {
-	if (device && (pos >= 2)) alt_avalon_sgdma_do_sync_transfer(device, first);
-	DeleteAllDescriptors();
+	bool borrowed = chainBorrowed;
+	Launch(true);
+
+	// caller may release borrowed buffers after return
+	if (borrowed) Wait();
 }
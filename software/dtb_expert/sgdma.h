@@ -5,20 +5,80 @@
 #define SGDMA_H_
 
 #include "cstdint.h"
+#include "system.h"
 #include "altera_avalon_sgdma.h"
 
 
+// largest transfer of one descriptor (bytes)
+#define SGDMA_MAX_TRANSFER 0xfff8
+
+// descriptor_memory (32 bytes per descriptor) is shared with the transmit
+// and receive SGDMA of the Ethernet MAC (tse_mac.cc) in designs that have
+// one: transmit head, data and end descriptor plus a receive ring.
+// Without the MAC 4 descriptors stay reserved.
+#define TSE_RX_FRAMES    8
+#ifdef TSE_MAC_BASE
+#define TSE_NDESCRIPTORS (3 + TSE_RX_FRAMES)
+#else
+#define TSE_NDESCRIPTORS 4
+#endif
+#define SGDMA_NDESCRIPTORS (DESCRIPTOR_MEMORY_SIZE_VALUE/32 - TSE_NDESCRIPTORS)
+
+#if SGDMA_NDESCRIPTORS < 4
+#error "descriptor_memory too small for the USB and Ethernet SGDMA descriptors"
+#endif
+
+
+// Asynchronous SGDMA transmit engine.
+//
+// The descriptors form a ring. Add() appends to the chain under
+// construction while the previous chain may still be on the wire.
+// Small buffers are copied into a staging area that belongs to the
+// descriptor, large buffers are transferred directly from the caller's
+// memory (borrowed). Send() starts the chain and returns immediately,
+// unless the chain contains borrowed buffers; in that case it waits
+// for completion because the caller may free them after returning.
+
 class CDma
 {
-	int pos;
 	alt_sgdma_dev *device;
-	alt_sgdma_descriptor *first;
-	alt_sgdma_descriptor *last;
+
+	// descriptor ring
+	int head;        // next free descriptor
+	int nFree;       // number of free descriptors
+	int chainStart;  // first descriptor of the chain under construction
+	int chainSize;   // descriptors used by this chain (incl. end descriptor)
+	bool chainBorrowed;
+	alt_sgdma_descriptor *last;  // end descriptor of this chain
+	alt_sgdma_descriptor *stage; // data descriptor with staging buffer or 0
+	uint16_t stageFill;          // bytes in its staging buffer
+
+	// chain on the wire
+	int activeSize;  // descriptors owned by the active chain
+	alt_sgdma_descriptor *activeLast;  // its last data descriptor
+	volatile bool active;
+	volatile bool notify;
+
+	// completion handler (called after a chain started by Send)
+	void (*handler)(void *context);
+	void *handlerContext;
+
 	alt_sgdma_descriptor* CreateDescriptor();
+	void NewChain();
+	void Append(const void *buffer, uint16_t size, bool copy);
+	void Launch(bool flush);
+	void Complete();
+	static void Irq(void *context);
 public:
 	CDma();
+	void SetHandler(void (*h)(void *context), void *context)
+	{ handler = h; handlerContext = context; }
 	bool Add(const void *buffer, uint32_t byte_size);
 	void Send();
+	void SendAsync();
+	void Commit();
+	bool Busy() { if (active) Complete(); return active; }
+	void Wait();
 	void DeleteAllDescriptors();
 //	void DumpDescriptorChain();
 };
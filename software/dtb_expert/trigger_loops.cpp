@@ -7,22 +7,20 @@
 
 // -------- Helper Functions -------------------------------
 
-// Use a maximum of 85% of allocated DAQ buffer before reading out:
-#define LOOP_MAX_FILLLEVEL  85
-#define LOOP_MAX_INTERRUPTS 150
-
-// Wait this long when setting DACs to lowest value
-// they need time to settle after large jumps. Time given in usec.
-#define LOOP_SETDAC_DELAY_LONG uDelay(70)
-#define LOOP_SETDAC_DELAY_SHORT uDelay(0)
+// Paced triggering: the DAQ DMA advances the write pointer by one 32 bit
+// SDRAM write (2 words, 6 clocks of DESER160 data), the writes can be held
+// back by the SDRAM arbitration (refresh, USB DMA and cache line bursts).
+// The readout is complete if the pointer stood still for longer than both
+// together (clocks), give up waiting after GetLoopTriggerDelay + timeout:
+#define LOOP_DMA_WRITE_CLOCKS 6
+#define LOOP_SDRAM_LATENCY   40
+#define LOOP_READOUT_QUIET   (LOOP_DMA_WRITE_CLOCKS + LOOP_SDRAM_LATENCY)
+#define LOOP_READOUT_TIMEOUT 1024
 
 // Reset the Loop Interrupt, so next Loop call starts from scratch:
 void CTestboard::LoopInterruptReset() {
   // Reset the interrupted Loop flag:
   LoopInterrupt = false;
-  LoopInterruptColumn = LoopInterruptRow = 0;
-  LoopInterruptDac1 = LoopInterruptDac2 = 0;
-  LoopInterruptDac1Stepsize = LoopInterruptDac2Stepsize = 1;
   LoopInterruptId = 0;
   LoopInterruptCounter = 0;
 
@@ -33,53 +31,70 @@ void CTestboard::LoopInterruptReset() {
 // Function to check (as fast as possible) if max fill level is reached:
 bool CTestboard::LoopInterruptStatus() {
 
+  // In pixel map mode the data is decoded on board and the buffers are emptied:
+  Daq_MapUpdate();
+
+  // Compare against the watermark set at Daq_Open, a single status read
+  // if the DMA core flags the threshold itself:
   for(uint8_t channel = 0; channel < DAQ_CHANNELS; channel++) {
     if(daq_mem_base[channel] == 0) continue;
-    if(Daq_GetSize(channel)*100 > LOOP_MAX_FILLLEVEL*daq_mem_size[channel]) return false;
+    if(daq_watermark_hw & (1 << channel)) {
+      if(DAQ_READ(DAQ_DMA_BASE[channel], DAQ_STATUS) & (DAQ_THRES | DAQ_MEM_OVFL)) return false;
+    }
+    else if(Daq_GetSize(channel) > daq_watermark[channel]) return false;
   }
   return true;
 }
 
-// Load the Loop Interrupt values to resume at interrupt position:
-void CTestboard::LoopInterruptResume(uint16_t id, uint8_t &column, uint8_t &row, size_t &dac1, uint8_t &dac1step, size_t &dac2, uint8_t &dac2step) {
+// Check if the loop with this id has been interrupted, its position is
+// kept by the caller. keep is set if no ROC command has been sent and no
+// ROC state has been lost since the interruption, the loop preamble can
+// be skipped then:
+bool CTestboard::LoopInterruptResume(uint16_t id, bool &keep) {
+
+  keep = false;
 
   // Loop is resumed: turn test loop LED on:
   ToggleLed(4,true);
 
   // No Loop has been interrupted, just start from beginning:
-  if(!LoopInterrupt) return;
+  if(!LoopInterrupt) return false;
 
   if(id != LoopInterruptId) {
     LoopInterruptReset();
-    return;
+    return false;
   }
 
-  // Recall the previous Loop's parameters and increemnt them by one:
-  column = LoopInterruptColumn;
-  row = LoopInterruptRow;
-  dac1 = LoopInterruptDac1;
-  dac1step = LoopInterruptDac1Stepsize;
-  dac2 = LoopInterruptDac2;
-  dac2step = LoopInterruptDac2Stepsize;
-
-  // Make sure we have valid increment settings:
-  if(dac1step < 1) dac1step = 1;
-  if(dac2step < 1) dac2step = 1;
+  // Check if the ROCs are still in the state the loop left them:
+  if(rocWritten != LoopInterruptRocWritten || rocInvalidated != LoopInterruptRocInvalidated) return true;
+  keep = true;
+  LoopResumeCount++;
+  LoopResumeSaved += LoopPreambleTime;
+  return true;
+}
+
+// Store the time the loop preamble took, saved by every cheap resume:
+void CTestboard::LoopPreambleDone(uint32_t start) {
+  i2c.Fence();
+  LoopPreambleTime = Time_us() - start;
+}
+
+// Number of loop resumes which skipped the preamble, total time saved in us:
+uint32_t CTestboard::LoopGetResumeStat(uint32_t &saved_us) {
+  saved_us = LoopResumeSaved;
+  return LoopResumeCount;
 }
 
-// Store the loop interrupt parameter to be recalled when rerunning the command:
-void CTestboard::LoopInterruptStore(uint16_t id, uint8_t column, uint8_t row, size_t dac1, uint8_t dac1step, size_t dac2, uint8_t dac2step) {
+// Mark the loop as interrupted, to be resumed when rerunning the command:
+void CTestboard::LoopInterruptStore(uint16_t id) {
 
   // Set the Loop Interrupt flag:
   LoopInterrupt = true;
   LoopInterruptId = id;
 
-  LoopInterruptColumn = column;
-  LoopInterruptRow = row;
-  LoopInterruptDac1 = dac1;
-  LoopInterruptDac1Stepsize = dac1step;
-  LoopInterruptDac2 = dac2;
-  LoopInterruptDac2Stepsize = dac2step;
+  // Remember the ROC state to detect changes until the loop is resumed:
+  LoopInterruptRocWritten = rocWritten;
+  LoopInterruptRocInvalidated = rocInvalidated;
 
   // Increment the number of interrupts:
   LoopInterruptCounter++;
@@ -146,6 +161,80 @@ uint16_t CTestboard::GetLoopTriggerDelay(uint16_t nTriggers) {
   return (readout_time + pg_delaysum + LoopTriggerDelay);
 }
 
+// Select fixed delay or readout paced triggering:
+void CTestboard::SetLoopTriggerMode(uint8_t mode) {
+  LoopTriggerMode = mode;
+  LoopTriggerPaced = LoopTriggerTimeouts = 0;
+  LoopTriggerIdle = 0;
+}
+
+// Number of paced triggers, timeouts = triggers without complete readout:
+uint32_t CTestboard::GetLoopTriggerStat(uint32_t &timeouts) {
+  timeouts = LoopTriggerTimeouts;
+  return LoopTriggerPaced;
+}
+
+// Send one loop trigger. delay = GetLoopTriggerDelay, waited before the
+// trigger in fixed mode. In paced mode the readout is waited for after
+// the trigger, delay + LOOP_READOUT_TIMEOUT is the time limit then:
+void CTestboard::LoopTrigger(uint16_t delay) {
+
+  if(LoopTriggerMode != LOOP_TRIGGER_PACED) {
+    cDelay(delay);
+    Pg_Single();
+    return;
+  }
+
+  // Remember the write pointers of the running DAQ channels with a data
+  // source. Channels that got no data for a previous trigger (no ROC or
+  // TBM connected) are watched but not waited for:
+  uint32_t wp[DAQ_CHANNELS];
+  uint8_t watched = 0, pending, started = 0;
+  uint8_t sources = Daq_DataChannels();
+  for(uint8_t channel = 0; channel < DAQ_CHANNELS; channel++) {
+    if(!(sources & (1 << channel))) continue;
+    unsigned int daq_base = DAQ_DMA_BASE[channel];
+    if(!(DAQ_READ(daq_base, DAQ_STATUS) & DAQ_RUNNING)) continue;
+    wp[channel] = DAQ_READ(daq_base, DAQ_MEM_WRITE);
+    watched |= 1 << channel;
+  }
+  pending = watched & ~LoopTriggerIdle;
+
+  Pg_Single();
+
+  // No data to wait for, fall back to the fixed delay:
+  if(!watched) {
+    cDelay(delay);
+    return;
+  }
+  LoopTriggerPaced++;
+
+  // Wait until every pending channel got data and no word arrived for the
+  // quiet time:
+  const uint32_t quiet = TimerClocks(LOOP_READOUT_QUIET + LoopTriggerDelay);
+  const uint32_t timeout = TimerClocks(delay + LOOP_READOUT_TIMEOUT);
+  uint32_t start = Time_clk(), last = start, now;
+  do {
+    now = Time_clk();
+    for(uint8_t channel = 0; channel < DAQ_CHANNELS; channel++) {
+      if(!(watched & (1 << channel))) continue;
+      uint32_t w = DAQ_READ(DAQ_DMA_BASE[channel], DAQ_MEM_WRITE);
+      if(w != wp[channel]) {
+	wp[channel] = w;
+	started |= 1 << channel;
+	last = now;
+      }
+    }
+    if((started & pending) == pending && now - last >= quiet) {
+      LoopTriggerIdle &= ~started;
+      return;
+    }
+  } while(now - start < timeout);
+
+  LoopTriggerTimeouts++;
+  LoopTriggerIdle = (LoopTriggerIdle | pending) & ~started;
+}
+
 // Setup of data storage structures in the NIOS stack. Stores all
 // ROC I2C addresses to be accessed later by functions which retrieve
 // trim values for a specific ROC:
@@ -155,7 +244,7 @@ bool CTestboard::SetI2CAddresses(vector<uint8_t> &roc_i2c) {
   printf("What I got (I2C):\n");
   for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
     ROC_I2C_ADDRESSES[roc] = roc_i2c.at(roc);
-    printf("%i: %i",roc,ROC_I2C_ADDRESSES[roc]);
+    printf("%i: %i",int(roc),ROC_I2C_ADDRESSES[roc]);
   }
 
   return true;
@@ -178,1088 +267,121 @@ bool CTestboard::SetTrimValues(uint8_t roc_i2c, vector<uint8_t> &trimvalues) {
   return true;
 }
 
-// Read the trim value of one specific pixel on a given ROC and trim the pixelk if necessary:
-void CTestboard::LoopPixTrim(uint8_t roc_i2c, uint8_t column, uint8_t row) {
-
-  // Lookup the index of this particular ROC:
-  size_t index = 0;
-  for(index = 0; index < MOD_NUMROCS; index++) {
-    if(ROC_I2C_ADDRESSES[index] == roc_i2c) { break; }
-  }
-
-  // Lookup the trim bits value of this particular pixel:
-  uint8_t value = ROC_TRIM_BITS[index*ROC_NUMROWS*ROC_NUMCOLS + column*ROC_NUMROWS + row];
-
-  // If the trim value is within the valid trim bit range (0-15) enable the pixel and trim it accordingly:
-  if(value < 16) roc_Pix_Trim(column, row, value);
-  // If not, do nothing - it's masked and should stay.
-
-  // Wait any additionally requested delay after trimming:
-  cDelay(LoopTrimDelay);
-}
-
-
 // -------- Simple Calibrate Functions for Maps -------------------------------
+// All loops are scan descriptors executed by Scan_Run (scan.cc).
 
 bool CTestboard::LoopMultiRocAllPixelsCalibrate(vector<uint8_t> &roc_i2c, uint16_t nTriggers, uint16_t flags) {
-
-  const uint16_t LoopId = 0x356a;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Check if we resume a previous loop:
-  uint8_t colstart = 0, rowstart = 0;
-  size_t dummy; uint8_t dummy2;
-  LoopInterruptResume(LoopId,colstart,rowstart,dummy,dummy2,dummy,dummy2);
-
-  for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-      roc_I2cAddr(roc_i2c.at(roc));
-      // If FLAG_FORCE_UNMASKED is not set, mask the chip:
-      if(!(flags&FLAG_FORCE_UNMASKED)) { roc_Chip_Mask(); }
-      // If FLAG_FORCE_UNMASKED is set, also attach all columns:
-      else { roc_AllCol_Enable(true); }
-  }
-
-  // Loop over all columns:
-  for (uint8_t col = colstart; col < ROC_NUMCOLS; col++) {
-
-    // Enable this column on every configured ROC:
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	roc_Col_Enable(col, true);
-      }
-    }
-
-    // Loop over all rows:
-    for (uint8_t row = rowstart; row < ROC_NUMROWS; row++) {
-
-      // Return true if we had too many retrys:
-      if(LoopInterruptCounter >= LOOP_MAX_INTERRUPTS) {
-	LoopInterruptReset();
-	return true;
-      }
-      // Interrupt the loop in case of high buffer fill level:
-      else if(!LoopInterruptStatus()) {
-	LoopInterruptStore(LoopId,col,row,0,1,0,1);
-	return false;
-      }
-
-      // Set the calibrate bits on every configured ROC
-      // Take into account both Xtalks and Cals flags
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-        roc_I2cAddr(roc_i2c.at(roc));
-	// If masked, enable the pixel:
-	if(!(flags&FLAG_FORCE_UNMASKED)) LoopPixTrim(roc_i2c.at(roc),col, row);
-	roc_Pix_Cal(col, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-      }
-
-      // Send the triggers:
-      for (uint16_t trig = 0; trig < nTriggers; trig++) {
-	// Delay the next trigger, depending in the data traffic we expect:
-	cDelay(TriggerDelay);
-	Pg_Single();
-      }
-
-      // Clear the calibrate signal on every ROC configured
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	if(!(flags&FLAG_FORCE_UNMASKED)) roc_Pix_Mask(col, row);
-	roc_ClrCal();
-      }
-    } // Loop over all rows
-
-    // Reset the rowstart:
-    rowstart = 0;
-
-    // Disable this column on every ROC configured:
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	roc_Col_Enable(col, false);
-      }
-    }
-
-  } // Loop over all columns
-
-  // If FLAG_FORCE_UNMASKED is set detach all columns:
-  if(flags&FLAG_FORCE_UNMASKED) {
-    for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-      roc_I2cAddr(roc_i2c.at(roc));
-      roc_AllCol_Enable(false);
-    }
-  }
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!Scan_Set(roc_i2c, nTriggers, flags)) return false;
+  return Scan_Run();
 }
 
 bool CTestboard::LoopMultiRocOnePixelCalibrate(vector<uint8_t> &roc_i2c, uint8_t column, uint8_t row, uint16_t nTriggers, uint16_t flags) {
-
-  //const uint16_t LoopId = 0xda4b;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Enable this column on every configured ROC:
-  // Set the calibrate bits on every configured ROC
-  // Take into account both Xtalks and Cals flags
-  for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-    roc_I2cAddr(roc_i2c.at(roc));
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      roc_Chip_Mask();
-      roc_Col_Enable(column, true);
-      // If masked, enable the pixel:
-      LoopPixTrim(roc_i2c.at(roc),column, row);
-    }
-    // With FLAG_FORCE_UNMASK, attach all columns:
-    else { roc_AllCol_Enable(true); }
-
-    roc_Pix_Cal(column, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-  }
-
-  // Send the triggers:
-  for (uint16_t trig = 0; trig < nTriggers; trig++) {
-    // Delay the next trigger, depending in the data traffic we expect:
-    cDelay(TriggerDelay);
-    Pg_Single();
-  }
-
-  // Clear the calibrate signal on every ROC configured
-  // Disable this column on every ROC configured:
-  for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-    roc_I2cAddr(roc_i2c.at(roc));
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      roc_Pix_Mask(column, row);
-      roc_Col_Enable(column, false);
-    }
-    else { roc_AllCol_Enable(false); }
-    roc_ClrCal();
-  }
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!Scan_Set(roc_i2c, nTriggers, flags)
+    || !ScanSetPixel(column, row)) return false;
+  return Scan_Run();
 }
 
 bool CTestboard::LoopSingleRocAllPixelsCalibrate(uint8_t roc_i2c, uint16_t nTriggers, uint16_t flags) {
-
-  const uint16_t LoopId = 0x77de;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Check if we resume a previous loop:
-  uint8_t colstart = 0, rowstart = 0;
-  size_t dummy; uint8_t dummy2;
-  LoopInterruptResume(LoopId,colstart,rowstart,dummy,dummy2,dummy,dummy2);
-  
-  // Set the I2C output to the correct ROC:
-  roc_I2cAddr(roc_i2c);
-  // If FLAG_FORCE_UNMASKED is not set, mask the chip:
-  if(!(flags&FLAG_FORCE_UNMASKED)) { roc_Chip_Mask(); }
-  // If FLAG_FORCE_UNMASKED is set, also attach all columns:
-  else { roc_AllCol_Enable(true); }
-
-  // Loop over all columns:
-  for (uint8_t col = colstart; col < ROC_NUMCOLS; col++) {
-
-    // Enable this column on the configured ROC:
-    if(!(flags&FLAG_FORCE_UNMASKED)) roc_Col_Enable(col, true);
-
-    // Loop over all rows:
-    for (uint8_t row = rowstart; row < ROC_NUMROWS; row++) {
-
-      // Return true if we had too many retrys:
-      if(LoopInterruptCounter >= LOOP_MAX_INTERRUPTS) {
-	LoopInterruptReset();
-	return true;
-      }
-      // Interrupt the loop in case of high buffer fill level:
-      else if(!LoopInterruptStatus()) {
-	LoopInterruptStore(LoopId,col,row,0,1,0,1);
-	return false;
-      }
-
-      // If masked, enable the pixel:
-      if(!(flags&FLAG_FORCE_UNMASKED)) LoopPixTrim(roc_i2c,col, row);
-
-      // Set the calibrate bits
-      // Take into account both Xtalks and Cals flags
-      roc_Pix_Cal(col, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-
-      // Send the triggers:
-      for (uint16_t trig = 0; trig < nTriggers; trig++) {
-	cDelay(TriggerDelay);
-	Pg_Single();
-      }
-
-      // Clear the calibrate signal
-      if(!(flags&FLAG_FORCE_UNMASKED)) roc_Pix_Mask(col, row);
-      roc_ClrCal();
-    } // Loop over all rows
-
-    // Reset the rowstart:
-    rowstart = 0;
-
-    // Disable this column on every ROC configured:
-    if(!(flags&FLAG_FORCE_UNMASKED)) roc_Col_Enable(col, false);
-
-  } // Loop over all columns
-
-  // If the chip was unmask, detach all columns:
-  if(flags&FLAG_FORCE_UNMASKED) { roc_AllCol_Enable(false); }
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!ScanSetRocs(&roc_i2c, 1, nTriggers, flags)) return false;
+  return Scan_Run();
 }
 
 bool CTestboard::LoopSingleRocOnePixelCalibrate(uint8_t roc_i2c, uint8_t column, uint8_t row, uint16_t nTriggers, uint16_t flags) {
-
-  //const uint16_t LoopId = 0x1b64;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Enable this column on the configured ROC:
-  // Set the calibrate bits on every configured ROC
-  // Take into account both Xtalks and Cals flags
-  roc_I2cAddr(roc_i2c);
-  // If FLAG_FORCE_UNMASKED is not set, mask the chip:
-  if(!(flags&FLAG_FORCE_UNMASKED)) {
-    roc_Chip_Mask();
-    roc_Col_Enable(column, true);
-    // If masked, enable the pixel:
-    LoopPixTrim(roc_i2c,column, row);
-  }
-  // If FLAG_FORCE_UNMASKED is set, also attach all columns:
-  else { roc_AllCol_Enable(true); }
-
-  roc_Pix_Cal(column, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-
-  // Send the triggers:
-  for (uint16_t trig = 0; trig < nTriggers; trig++) {
-    cDelay(TriggerDelay);
-    Pg_Single();
-  }
-
-  // Clear the calibrate signal on thr ROC configured
-  // Disable this column on the ROC configured:
-  if(!(flags&FLAG_FORCE_UNMASKED)) {
-    roc_Pix_Mask(column, row);
-    roc_Col_Enable(column, false);
-  }
-  // If the chip was unmask, detach all columns:
-  else { roc_AllCol_Enable(false); }
-
-  roc_ClrCal();
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!ScanSetRocs(&roc_i2c, 1, nTriggers, flags)
+    || !ScanSetPixel(column, row)) return false;
+  return Scan_Run();
 }
 
 
 // -------- Trigger Loop Functions for 1D Dac Scans -------------------------------
 
 bool CTestboard::LoopMultiRocAllPixelsDacScan(vector<uint8_t> &roc_i2c, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1low, uint8_t dac1high) {
-
-  // Setting the default increment step size for DAC scan to 1:
   return LoopMultiRocAllPixelsDacScan(roc_i2c, nTriggers, flags, dac1register, 1, dac1low, dac1high);
 }
 
 bool CTestboard::LoopMultiRocAllPixelsDacScan(vector<uint8_t> &roc_i2c, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1step, uint8_t dac1low, uint8_t dac1high) {
-
-  const uint16_t LoopId = 0xac34;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Check if we resume a previous loop:
-  uint8_t colstart = 0, rowstart = 0;
-  size_t dac1start = dac1low;
-  size_t dummy; uint8_t dummy2;
-  LoopInterruptResume(LoopId,colstart,rowstart,dac1start,dac1step,dummy,dummy2);
-
-  for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-    roc_I2cAddr(roc_i2c.at(roc));
-    // If FLAG_FORCE_UNMASKED is not set, mask the chip:
-    if(!(flags&FLAG_FORCE_UNMASKED)) { roc_Chip_Mask(); }
-    // With FLAG_FORCE_UNMASK, attach all columns:
-    else { roc_AllCol_Enable(true); }
-  }
-
-  // Loop over all columns:
-  for (uint8_t col = colstart; col < ROC_NUMCOLS; col++) {
-
-    // Enable this column on every configured ROC:
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	roc_Col_Enable(col, true);
-      }
-    }
-
-    // Loop over all rows:
-    for (uint8_t row = rowstart; row < ROC_NUMROWS; row++) {
-
-      // Set the calibrate bits on every configured ROC
-      // Take into account both Xtalks and Cals flags
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	// If masked, enable the pixel:
-	if(!(flags&FLAG_FORCE_UNMASKED)) LoopPixTrim(roc_i2c.at(roc),col, row);
-	roc_Pix_Cal(col, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-      }
-
-      // Loop over the DAC range specified:
-      for (size_t dac1 = dac1start; dac1 <= dac1high; dac1 += dac1step) {
-
-	// Return true if we had too many retrys:
-	if(LoopInterruptCounter >= LOOP_MAX_INTERRUPTS) {
-	  LoopInterruptReset();
-	  return true;
-	}
-	// Interrupt the loop in case of high buffer fill level:
-	else if(!LoopInterruptStatus()) {
-	  LoopInterruptStore(LoopId,col,row,dac1,dac1step,0,1);
-	  return false;
-	}
-
-	// Update the DAC setting on all configured ROCS:
-	for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	  roc_I2cAddr(roc_i2c.at(roc));
-	  // Check if we need to correct the DAC value to be set:
-	  if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac1register, dac1);
-	  else roc_SetDAC(dac1register, CalibratedDAC(dac1register,dac1));
-	}
-
-	// Give the DAC time so settle:
-	if(dac1 == dac1low) LOOP_SETDAC_DELAY_LONG;
-	else { LOOP_SETDAC_DELAY_SHORT; }
-
-
-	// Send the triggers:
-	for (uint16_t trig = 0; trig < nTriggers; trig++) {
-	  // Delay the next trigger, depending in the data traffic we expect:
-	  cDelay(TriggerDelay);
-	  Pg_Single();
-	}
-      } // Loop over the DAC range
-
-      // Reset the dac1start:
-      dac1start = dac1low;
-
-      // Clear the calibrate signal on every ROC configured
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	if(!(flags&FLAG_FORCE_UNMASKED)) roc_Pix_Mask(col, row);
-	roc_ClrCal();
-      }
-    } // Loop over all rows
-
-    // Reset the rowstart:
-    rowstart = 0;
-
-    // Disable this column on every ROC configured:
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	roc_Col_Enable(col, false);
-      }
-    }
-
-  } // Loop over all columns
-
-  // If the chip was unmask, detach all columns:
-  if(flags&FLAG_FORCE_UNMASKED) { 
-    for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-      roc_I2cAddr(roc_i2c.at(roc));
-      roc_AllCol_Enable(false);
-    }
-  }
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!Scan_Set(roc_i2c, nTriggers, flags)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac1register, dac1low, dac1high, dac1step)) return false;
+  return Scan_Run();
 }
 
 bool CTestboard::LoopMultiRocOnePixelDacScan(vector<uint8_t> &roc_i2c, uint8_t column, uint8_t row, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1low, uint8_t dac1high) {
-
   return LoopMultiRocOnePixelDacScan(roc_i2c, column, row, nTriggers, flags, dac1register, 1, dac1low, dac1high);
 }
 
 bool CTestboard::LoopMultiRocOnePixelDacScan(vector<uint8_t> &roc_i2c, uint8_t column, uint8_t row, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1step, uint8_t dac1low, uint8_t dac1high) {
-
-  const uint16_t LoopId = 0xc1df;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Check if we resume a previous loop:
-  uint8_t dummy; size_t dummy2;
-  size_t dac1start = dac1low;
-  LoopInterruptResume(LoopId,dummy,dummy,dac1start,dac1step,dummy2,dummy);
-
-  // Enable this column on every configured ROC:
-  // Set the calibrate bits on every configured ROC
-  // Take into account both Xtalks and Cals flags
-  for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-    roc_I2cAddr(roc_i2c.at(roc));
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      roc_Chip_Mask();
-      roc_Col_Enable(column, true);
-      // If masked, enable the pixel:
-      LoopPixTrim(roc_i2c.at(roc),column, row);
-    }
-    // With FLAG_FORCE_UNMASK, attach all columns:
-    else { roc_AllCol_Enable(true); }
-
-    roc_Pix_Cal(column, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-  }
-
-  // Loop over the DAC range specified:
-  for (size_t dac1 = dac1start; dac1 <= dac1high; dac1 += dac1step) {
-
-    // Return true if we had too many retrys:
-    if(LoopInterruptCounter >= LOOP_MAX_INTERRUPTS) {
-      LoopInterruptReset();
-      return true;
-    }
-    // Interrupt the loop in case of high buffer fill level:
-    else if(!LoopInterruptStatus()) {
-      LoopInterruptStore(LoopId,0,0,dac1,dac1step,0,1);
-      return false;
-    }
-
-    // Update the DAC setting on all configured ROCS:
-    for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-      roc_I2cAddr(roc_i2c.at(roc));
-      // Check if we need to correct the DAC value to be set:
-      if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac1register, dac1);
-      else roc_SetDAC(dac1register, CalibratedDAC(dac1register,dac1));
-    }
-
-    // Give the DAC time so settle:
-    if(dac1 == dac1low) LOOP_SETDAC_DELAY_LONG;
-    else { LOOP_SETDAC_DELAY_SHORT; }
-
-
-    // Send the triggers:
-    for (uint16_t trig = 0; trig < nTriggers; trig++) {
-      // Delay the next trigger, depending in the data traffic we expect:
-      cDelay(TriggerDelay);
-      Pg_Single();
-    }
-  } // Loop over the DAC range
-
-  // Clear the calibrate signal on every ROC configured
-  // Disable this column on every ROC configured:
-  for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-    roc_I2cAddr(roc_i2c.at(roc));
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      roc_Pix_Mask(column, row);
-      roc_Col_Enable(column, false);
-    }
-    // If the chip was unmask, detach all columns:
-    else { roc_AllCol_Enable(false); }
-    roc_ClrCal();
-  }
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!Scan_Set(roc_i2c, nTriggers, flags)
+    || !ScanSetPixel(column, row)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac1register, dac1low, dac1high, dac1step)) return false;
+  return Scan_Run();
 }
 
 bool CTestboard::LoopSingleRocAllPixelsDacScan(uint8_t roc_i2c, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1low, uint8_t dac1high) {
-
   return LoopSingleRocAllPixelsDacScan(roc_i2c, nTriggers, flags, dac1register, 1, dac1low, dac1high);
 }
 
 bool CTestboard::LoopSingleRocAllPixelsDacScan(uint8_t roc_i2c, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1step, uint8_t dac1low, uint8_t dac1high) {
-
-  const uint16_t LoopId = 0x902b;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Check if we resume a previous loop:
-  uint8_t colstart = 0, rowstart = 0;
-  size_t dac1start = dac1low;
-  size_t dummy; uint8_t dummy2;
-  LoopInterruptResume(LoopId,colstart,rowstart,dac1start,dac1step,dummy,dummy2);
-
-  // Set the I2C output to the correct ROC:
-  roc_I2cAddr(roc_i2c);
-  // If FLAG_FORCE_UNMASKED is not set, mask the chip:
-  if(!(flags&FLAG_FORCE_UNMASKED)) { roc_Chip_Mask(); }
-  // If FLAG_FORCE_UNMASKED is set, also attach all columns:
-  else { roc_AllCol_Enable(true); }
-
-  // Loop over all columns:
-  for (uint8_t col = colstart; col < ROC_NUMCOLS; col++) {
-
-    // Enable this column on the configured ROC:
-    if(!(flags&FLAG_FORCE_UNMASKED)) roc_Col_Enable(col, true);
-
-    // Loop over all rows:
-    for (uint8_t row = rowstart; row < ROC_NUMROWS; row++) {
-
-      // If masked, enable the pixel:
-      if(!(flags&FLAG_FORCE_UNMASKED)) LoopPixTrim(roc_i2c,col, row);
-
-      // Set the calibrate bits
-      // Take into account both Xtalks and Cals flags
-      roc_Pix_Cal(col, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-
-      // Loop over the DAC range specified:
-      for (size_t dac1 = dac1start; dac1 <= dac1high; dac1 += dac1step) {
-
-	// Return true if we had too many retrys:
-	if(LoopInterruptCounter >= LOOP_MAX_INTERRUPTS) {
-	  LoopInterruptReset();
-	  return true;
-	}
-	// Interrupt the loop in case of high buffer fill level:
-	else if(!LoopInterruptStatus()) {
-	  LoopInterruptStore(LoopId,col,row,dac1,dac1step,0,1);
-	  return false;
-	}
-
-	// Update the DAC setting on the ROC:
-	// Check if we need to correct the DAC value to be set:
-	if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac1register, dac1);
-	else roc_SetDAC(dac1register, CalibratedDAC(dac1register,dac1));
-
-	// Give the DAC time so settle from dac1high to dac1low
-	if(dac1 == dac1low) LOOP_SETDAC_DELAY_LONG;
-	else { LOOP_SETDAC_DELAY_SHORT; }
-
-
-	// Send the triggers:
-	for (uint16_t trig = 0; trig < nTriggers; trig++) {
-	  cDelay(TriggerDelay);
-	  Pg_Single();
-	}
-      } // Loop over the DAC range
-
-      // Reset the dac1start:
-      dac1start = dac1low;
-
-      // Clear the calibrate signal
-      if(!(flags&FLAG_FORCE_UNMASKED)) roc_Pix_Mask(col, row);
-      roc_ClrCal();
-    } // Loop over all rows
-
-    // Reset the rowstart:
-    rowstart = 0;
-
-    // Disable this column on every ROC configured:
-    if(!(flags&FLAG_FORCE_UNMASKED)) roc_Col_Enable(col, false);
-
-  } // Loop over all columns
-
-  // If the chip was unmask, detach all columns:
-  if(!(flags&FLAG_FORCE_UNMASKED)) { roc_AllCol_Enable(false); }
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!ScanSetRocs(&roc_i2c, 1, nTriggers, flags)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac1register, dac1low, dac1high, dac1step)) return false;
+  return Scan_Run();
 }
 
 bool CTestboard::LoopSingleRocOnePixelDacScan(uint8_t roc_i2c, uint8_t column, uint8_t row, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1low, uint8_t dac1high) {
-
   return LoopSingleRocOnePixelDacScan(roc_i2c, column, row, nTriggers, flags, dac1register, 1, dac1low, dac1high);
 }
 
 bool CTestboard::LoopSingleRocOnePixelDacScan(uint8_t roc_i2c, uint8_t column, uint8_t row, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1step, uint8_t dac1low, uint8_t dac1high) {
-
-  const uint16_t LoopId = 0xfe5d;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Check if we resume a previous loop:
-  uint8_t dummy; size_t dummy2;
-  size_t dac1start = dac1low;
-  LoopInterruptResume(LoopId,dummy,dummy,dac1start,dac1step,dummy2,dummy);
-
-  // Enable this column on the configured ROC:
-  // Set the calibrate bits on every configured ROC
-  // Take into account both Xtalks and Cals flags
-  roc_I2cAddr(roc_i2c);
-  // If FLAG_FORCE_UNMASKED is not set, mask the chip:
-  if(!(flags&FLAG_FORCE_UNMASKED)) {
-    roc_Chip_Mask();
-    roc_Col_Enable(column, true);
-    // If masked, enable the pixel:
-    LoopPixTrim(roc_i2c,column, row);
-  }
-  // If FLAG_FORCE_UNMASKED is set, also attach all columns:
-  else { roc_AllCol_Enable(true); }
-
-  roc_Pix_Cal(column, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-
-  // Loop over the DAC range specified:
-  for (size_t dac1 = dac1start; dac1 <= dac1high; dac1 += dac1step) {
-
-    // Return true if we had too many retrys:
-    if(LoopInterruptCounter >= LOOP_MAX_INTERRUPTS) {
-      LoopInterruptReset();
-      return true;
-    }
-    // Interrupt the loop in case of high buffer fill level:
-    else if(!LoopInterruptStatus()) {
-      LoopInterruptStore(LoopId,0,0,dac1,dac1step,0,1);
-      return false;
-    }
-
-    // Update the DAC setting on the ROC:
-    // Check if we need to correct the DAC value to be set:
-    if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac1register, dac1);
-    else roc_SetDAC(dac1register, CalibratedDAC(dac1register,dac1));
-
-    // Give the DAC time so settle:
-    if(dac1 == dac1low) LOOP_SETDAC_DELAY_LONG;
-    else { LOOP_SETDAC_DELAY_SHORT; }
-
-    // Send the triggers:
-    for (uint16_t trig = 0; trig < nTriggers; trig++) {
-      cDelay(TriggerDelay);
-      Pg_Single();
-    }
-  } // Loop over the DAC range
-
-  // Clear the calibrate signal on thr ROC configured
-  // Disable this column on the ROC configured:
-  if(!(flags&FLAG_FORCE_UNMASKED)) {
-    roc_Pix_Mask(column, row);
-    roc_Col_Enable(column, false);
-  }
-  // If the chip was unmask, detach all columns:
-  else { roc_AllCol_Enable(false); }
-
-  roc_ClrCal();
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!ScanSetRocs(&roc_i2c, 1, nTriggers, flags)
+    || !ScanSetPixel(column, row)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac1register, dac1low, dac1high, dac1step)) return false;
+  return Scan_Run();
 }
 
+
 // -------- Trigger Loop Functions for 2D DacDac Scans ----------------------------
 
 bool CTestboard::LoopMultiRocAllPixelsDacDacScan(vector<uint8_t> &roc_i2c, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1low, uint8_t dac1high, uint8_t dac2register, uint8_t dac2low, uint8_t dac2high) {
-
   return LoopMultiRocAllPixelsDacDacScan(roc_i2c, nTriggers, flags, dac1register, 1, dac1low, dac1high, dac2register, 1, dac2low, dac2high);
 }
 
 bool CTestboard::LoopMultiRocAllPixelsDacDacScan(vector<uint8_t> &roc_i2c, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1step, uint8_t dac1low, uint8_t dac1high, uint8_t dac2register, uint8_t dac2step, uint8_t dac2low, uint8_t dac2high) {
-
-  const uint16_t LoopId = 0x0ade;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Check if we resume a previous loop:
-  uint8_t colstart = 0, rowstart = 0;
-  size_t dac1start = dac1low, dac2start = dac2low;
-  LoopInterruptResume(LoopId,colstart,rowstart,dac1start,dac1step,dac2start,dac2step);
-
-  for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-      roc_I2cAddr(roc_i2c.at(roc));
-      // If FLAG_FORCE_UNMASKED is not set, mask the chip:
-      if(!(flags&FLAG_FORCE_UNMASKED)) { roc_Chip_Mask(); }
-      // With FLAG_FORCE_UNMASK, attach all columns:
-      else { roc_AllCol_Enable(true); }
-  }
-
-  // Loop over all columns:
-  for (uint8_t col = colstart; col < ROC_NUMCOLS; col++) {
-
-    // Enable this column on every configured ROC:
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	roc_Col_Enable(col, true);
-      }
-    }
-
-    // Loop over all rows:
-    for (uint8_t row = rowstart; row < ROC_NUMROWS; row++) {
-
-      // Set the calibrate bits on every configured ROC
-      // Take into account both Xtalks and Cals flags
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	// If masked, enable the pixel:
-	if(!(flags&FLAG_FORCE_UNMASKED)) LoopPixTrim(roc_i2c.at(roc),col, row);
-	roc_Pix_Cal(col, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-      }
-
-      // Loop over the DAC1 range specified:
-      for (size_t dac1 = dac1start; dac1 <= dac1high; dac1 += dac1step) {
-
-	// Update the DAC1 setting on all configured ROCS:
-	for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	  roc_I2cAddr(roc_i2c.at(roc));
-	  // Check if we need to correct the DAC value to be set:
-	  if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac1register, dac1);
-	  else roc_SetDAC(dac1register, CalibratedDAC(dac1register,dac1));
-	}
-
-	// Loop over the DAC2 range specified:
-	for (size_t dac2 = dac2start; dac2 <= dac2high; dac2 += dac2step) {
-
-	  // Return true if we had too many retrys:
-	  if(LoopInterruptCounter >= LOOP_MAX_INTERRUPTS) {
-	    LoopInterruptReset();
-	    return true;
-	  }
-	  // Interrupt the loop in case of high buffer fill level:
-	  else if(!LoopInterruptStatus()) {
-	    LoopInterruptStore(LoopId,col,row,dac1,dac1step,dac2,dac2step);
-	    return false;
-	  }
-
-	  // Update the DAC2 setting on all configured ROCS:
-	  for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	    roc_I2cAddr(roc_i2c.at(roc));
-	    // Check if we need to correct the DAC value to be set:
-	    if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac2register, dac2);
-	    else roc_SetDAC(dac2register, CalibratedDAC(dac2register,dac2));
-	  }
-
-	  // Give the DAC time so settle:
-	  if(dac2 == dac2low) LOOP_SETDAC_DELAY_LONG;
-	  else { LOOP_SETDAC_DELAY_SHORT; }
-
-	  // Send the triggers:
-	  for (uint16_t trig = 0; trig < nTriggers; trig++) {
-	    // Delay the next trigger, depending in the data traffic we expect:
-	    cDelay(TriggerDelay);
-	    Pg_Single();
-	  }
-	} // Loop over the DAC2 range
-
-	// Reset the dac2start:
-	dac2start = dac2low;
-
-      } // Loop over the DAC1 range
-
-      // Reset the dac1start:
-      dac1start = dac1low;
-
-      // Clear the calibrate signal on every ROC configured
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	if(!(flags&FLAG_FORCE_UNMASKED)) roc_Pix_Mask(col, row);
-	roc_ClrCal();
-      }
-    } // Loop over all rows
-
-    // Reset the rowstart:
-    rowstart = 0;
-
-    // Disable this column on every ROC configured:
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	roc_Col_Enable(col, false);
-      }
-    }
-
-  } // Loop over all columns
-
-  // If the chip was unmask, detach all columns:
-  if(flags&FLAG_FORCE_UNMASKED) { 
-    for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-      roc_I2cAddr(roc_i2c.at(roc));
-      roc_AllCol_Enable(false);
-    }
-  }
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!Scan_Set(roc_i2c, nTriggers, flags)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac1register, dac1low, dac1high, dac1step)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac2register, dac2low, dac2high, dac2step)) return false;
+  return Scan_Run();
 }
 
 bool CTestboard::LoopMultiRocOnePixelDacDacScan(vector<uint8_t> &roc_i2c, uint8_t column, uint8_t row, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1low, uint8_t dac1high, uint8_t dac2register, uint8_t dac2low, uint8_t dac2high) {
-
   return LoopMultiRocOnePixelDacDacScan(roc_i2c, column, row, nTriggers, flags, dac1register, 1, dac1low, dac1high, dac2register, 1, dac2low, dac2high);
 }
 
 bool CTestboard::LoopMultiRocOnePixelDacDacScan(vector<uint8_t> &roc_i2c, uint8_t column, uint8_t row, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1step, uint8_t dac1low, uint8_t dac1high, uint8_t dac2register, uint8_t dac2step, uint8_t dac2low, uint8_t dac2high) {
-
-  const uint16_t LoopId = 0xb1d5;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Check if we resume a previous loop:
-  uint8_t dummy;
-  size_t dac1start = dac1low, dac2start = dac2low;
-  LoopInterruptResume(LoopId,dummy,dummy,dac1start,dac1step,dac2start,dac2step);
-
-  // Enable this column on every configured ROC:
-  // Set the calibrate bits on every configured ROC
-  // Take into account both Xtalks and Cals flags
-  for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-    roc_I2cAddr(roc_i2c.at(roc));
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      roc_Chip_Mask();
-      roc_Col_Enable(column, true);
-      // If masked, enable the pixel:
-      LoopPixTrim(roc_i2c.at(roc),column, row);
-    }
-    // With FLAG_FORCE_UNMASK, attach all columns:
-    else { roc_AllCol_Enable(true); }
-
-    roc_Pix_Cal(column, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-  }
-
-  // Loop over the DAC1 range specified:
-  for (size_t dac1 = dac1start; dac1 <= dac1high; dac1 += dac1step) {
-    
-    // Update the DAC1 setting on all configured ROCS:
-    for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-      roc_I2cAddr(roc_i2c.at(roc));
-      // Check if we need to correct the DAC value to be set:
-      if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac1register, dac1);
-      else roc_SetDAC(dac1register, CalibratedDAC(dac1register,dac1));
-    }
-
-    // Loop over the DAC2 range specified:
-    for (size_t dac2 = dac2start; dac2 <= dac2high; dac2 += dac2step) {
-
-      // Return true if we had too many retrys:
-      if(LoopInterruptCounter >= LOOP_MAX_INTERRUPTS) {
-	LoopInterruptReset();
-	return true;
-      }
-      // Interrupt the loop in case of high buffer fill level:
-      else if(!LoopInterruptStatus()) {
-	LoopInterruptStore(LoopId,0,0,dac1,dac1step,dac2,dac2step);
-	return false;
-      }
-
-      // Update the DAC2 setting on all configured ROCS:
-      for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-	roc_I2cAddr(roc_i2c.at(roc));
-	// Check if we need to correct the DAC value to be set:
-	if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac2register, dac2);
-	else roc_SetDAC(dac2register, CalibratedDAC(dac2register,dac2));
-      }
-
-      // Give the DAC time so settle:
-      if(dac2 == dac2low) LOOP_SETDAC_DELAY_LONG;
-      else { LOOP_SETDAC_DELAY_SHORT; }
-
-      // Send the triggers:
-      for (uint16_t trig = 0; trig < nTriggers; trig++) {
-	// Delay the next trigger, depending in the data traffic we expect:
-        cDelay(TriggerDelay);
-	Pg_Single();
-      }
-    } // Loop over the DAC2 range
-
-    // Reset the dac2start:
-    dac2start = dac2low;
-
-  } // Loop over the DAC1 range
-
-  // Clear the calibrate signal on every ROC configured
-  // Disable this column on every ROC configured:
-  for(size_t roc = 0; roc < roc_i2c.size(); roc++) {
-    roc_I2cAddr(roc_i2c.at(roc));
-    if(!(flags&FLAG_FORCE_UNMASKED)) {
-      roc_Pix_Mask(column, row);
-      roc_Col_Enable(column, false);
-    }
-    // If the chip was unmask, detach all columns:
-    else { roc_AllCol_Enable(false); }
-
-    roc_ClrCal();
-  }
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!Scan_Set(roc_i2c, nTriggers, flags)
+    || !ScanSetPixel(column, row)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac1register, dac1low, dac1high, dac1step)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac2register, dac2low, dac2high, dac2step)) return false;
+  return Scan_Run();
 }
 
 bool CTestboard::LoopSingleRocAllPixelsDacDacScan(uint8_t roc_i2c, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1low, uint8_t dac1high, uint8_t dac2register, uint8_t dac2low, uint8_t dac2high) {
-
   return LoopSingleRocAllPixelsDacDacScan(roc_i2c, nTriggers, flags, dac1register, 1, dac1low, dac1high, dac2register, 1, dac2low, dac2high);
 }
 
 bool CTestboard::LoopSingleRocAllPixelsDacDacScan(uint8_t roc_i2c, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1step, uint8_t dac1low, uint8_t dac1high, uint8_t dac2register, uint8_t dac2step, uint8_t dac2low, uint8_t dac2high) {
-
-  const uint16_t LoopId = 0x17ba;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Check if we resume a previous loop:
-  uint8_t colstart = 0, rowstart = 0;
-  size_t dac1start = dac1low, dac2start = dac2low;
-  LoopInterruptResume(LoopId,colstart,rowstart,dac1start,dac1step,dac2start,dac2step);
-
-  // Set the I2C output to the correct ROC:
-  roc_I2cAddr(roc_i2c);
-  // If FLAG_FORCE_UNMASKED is not set, mask the chip:
-  if(!(flags&FLAG_FORCE_UNMASKED)) { roc_Chip_Mask(); }
-  // If FLAG_FORCE_UNMASKED is set, also attach all columns:
-  else { roc_AllCol_Enable(true); }
-
-  // Loop over all columns:
-  for (uint8_t col = colstart; col < ROC_NUMCOLS; col++) {
-
-    // Enable this column on the configured ROC:
-    if(!(flags&FLAG_FORCE_UNMASKED)) roc_Col_Enable(col, true);
-
-    // Loop over all rows:
-    for (uint8_t row = rowstart; row < ROC_NUMROWS; row++) {
-
-      // If masked, enable the pixel:
-      if(!(flags&FLAG_FORCE_UNMASKED)) LoopPixTrim(roc_i2c,col, row);
-
-      // Set the calibrate bits
-      // Take into account both Xtalks and Cals flags
-      roc_Pix_Cal(col, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-
-      // Loop over the DAC1 range specified:
-      for (size_t dac1 = dac1start; dac1 <= dac1high; dac1 += dac1step) {
-    
-	// Update the DAC1 setting on the configured ROC:
-	// Check if we need to correct the DAC value to be set:
-	if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac1register, dac1);
-	else roc_SetDAC(dac1register, CalibratedDAC(dac1register,dac1));
-
-	// Loop over the DAC2 range specified:
-	for (size_t dac2 = dac2start; dac2 <= dac2high; dac2 += dac2step) {
-
-	  // Return true if we had too many retrys:
-	  if(LoopInterruptCounter >= LOOP_MAX_INTERRUPTS) {
-	    LoopInterruptReset();
-	    return true;
-	  }
-	  // Interrupt the loop in case of high buffer fill level:
-	  else if(!LoopInterruptStatus()) {
-	    LoopInterruptStore(LoopId,col,row,dac1,dac1step,dac2,dac2step);
-	    return false;
-	  }
-
-	  // Update the DAC2 setting on the configured ROC:
-	  // Check if we need to correct the DAC value to be set:
-	  if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac2register, dac2);
-	  else roc_SetDAC(dac2register, CalibratedDAC(dac2register,dac2));
-
-	  // Give the DAC time so settle:
-	  if(dac2 == dac2low) LOOP_SETDAC_DELAY_LONG;
-	  else { LOOP_SETDAC_DELAY_SHORT; }
-
-	  // Send the triggers:
-	  for (uint16_t trig = 0; trig < nTriggers; trig++) {
-	    cDelay(TriggerDelay);
-	    Pg_Single();
-	  }
-	} // Loop over the DAC2 range
-
-	// Reset the dac2start:
-	dac2start = dac2low;
-
-      } // Loop over the DAC1 range
-
-      // Reset the dac1start:
-      dac1start = dac1low;
-
-      // Clear the calibrate signal
-      if(!(flags&FLAG_FORCE_UNMASKED)) roc_Pix_Mask(col, row);
-      roc_ClrCal();
-    } // Loop over all rows
-
-      // Reset the rowstart:
-      rowstart = 0;
-
-    // Disable this column on every ROC configured:
-    if(!(flags&FLAG_FORCE_UNMASKED)) roc_Col_Enable(col, false);
-
-  } // Loop over all columns
-
-  // If the chip was unmask, detach all columns:
-  if(flags&FLAG_FORCE_UNMASKED) { roc_AllCol_Enable(false); }
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!ScanSetRocs(&roc_i2c, 1, nTriggers, flags)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac1register, dac1low, dac1high, dac1step)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac2register, dac2low, dac2high, dac2step)) return false;
+  return Scan_Run();
 }
 
 bool CTestboard::LoopSingleRocOnePixelDacDacScan(uint8_t roc_i2c, uint8_t column, uint8_t row, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1low, uint8_t dac1high, uint8_t dac2register, uint8_t dac2low, uint8_t dac2high) {
-
   return LoopSingleRocOnePixelDacDacScan(roc_i2c, column, row, nTriggers, flags, dac1register, 1, dac1low, dac1high, dac2register, 1, dac2low, dac2high);
 }
 
 bool CTestboard::LoopSingleRocOnePixelDacDacScan(uint8_t roc_i2c, uint8_t column, uint8_t row, uint16_t nTriggers, uint16_t flags, uint8_t dac1register, uint8_t dac1step, uint8_t dac1low, uint8_t dac1high, uint8_t dac2register, uint8_t dac2step, uint8_t dac2low, uint8_t dac2high) {
-
-  const uint16_t LoopId = 0x7b52;
-  const uint16_t TriggerDelay = GetLoopTriggerDelay(nTriggers);
-
-  // Check if we resume a previous loop:
-  uint8_t dummy;
-  size_t dac1start = dac1low, dac2start = dac2low;
-  LoopInterruptResume(LoopId,dummy,dummy,dac1start,dac1step,dac2start,dac2step);
-
-  // Enable this column on the configured ROC:
-  // Set the calibrate bits on every configured ROC
-  // Take into account both Xtalks and Cals flags
-  roc_I2cAddr(roc_i2c);
-  // If FLAG_FORCE_UNMASKED is not set, mask the chip:
-  if(!(flags&FLAG_FORCE_UNMASKED)) {
-    roc_Chip_Mask();
-    roc_Col_Enable(column, true);
-    // If masked, enable the pixel:
-    LoopPixTrim(roc_i2c,column, row);
-  }
-  // If FLAG_FORCE_UNMASKED is set, also attach all columns:
-  else { roc_AllCol_Enable(true); }
-
-  roc_Pix_Cal(column, GetXtalkRow(row,(flags&FLAG_XTALK)), (flags&FLAG_CALS));
-
-  // Loop over the DAC range specified:
-  for (size_t dac1 = dac1start; dac1 <= dac1high; dac1 += dac1step) {
-
-    // Update the DAC1 setting on the configured ROC:
-    // Check if we need to correct the DAC value to be set:
-    if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac1register, dac1);
-    else roc_SetDAC(dac1register, CalibratedDAC(dac1register,dac1));
-
-    // Loop over the DAC2 range specified:
-    for (size_t dac2 = dac2start; dac2 <= dac2high; dac2 += dac2step) {
-
-      // Return true if we had too many retrys:
-      if(LoopInterruptCounter >= LOOP_MAX_INTERRUPTS) {
-	LoopInterruptReset();
-	return true;
-      }
-      // Interrupt the loop in case of high buffer fill level:
-      else if(!LoopInterruptStatus()) {
-	LoopInterruptStore(LoopId,0,0,dac1,dac1step,dac2,dac2step);
-	return false;
-      }
-
-      // Update the DAC2 setting on the configured ROC:
-      // Check if we need to correct the DAC value to be set:
-      if(flags&FLAG_DISABLE_DACCAL) roc_SetDAC(dac2register, dac2);
-      else roc_SetDAC(dac2register, CalibratedDAC(dac2register,dac2));
-
-      // Give the DAC time so settle after setting:
-      if(dac2 == dac2low) LOOP_SETDAC_DELAY_LONG;
-      else { LOOP_SETDAC_DELAY_SHORT; }
-
-      // Send the triggers:
-      for (uint16_t trig = 0; trig < nTriggers; trig++) {
-	cDelay(TriggerDelay);
-	Pg_Single();
-      }
-    } // Loop over the DAC2 range
-
-    // Reset the dac2start:
-    dac2start = dac2low;
-
-  } // Loop over the DAC1 range
-
-  // Clear the calibrate signal on the ROC configured
-  // Disable this column on the ROC configured:
-  if(!(flags&FLAG_FORCE_UNMASKED)) {
-    roc_Pix_Mask(column, row);
-    roc_Col_Enable(column, false);
-  }
-  // If the chip was unmask, detach all columns:
-  else { roc_AllCol_Enable(false); }
-
-  roc_ClrCal();
-
-  // Reached the end of the loop:
-  LoopInterruptReset();
-  return true;
+  if (!ScanSetRocs(&roc_i2c, 1, nTriggers, flags)
+    || !ScanSetPixel(column, row)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac1register, dac1low, dac1high, dac1step)
+    || !Scan_AddAxis(SCAN_ROCDAC, dac2register, dac2low, dac2high, dac2step)) return false;
+  return Scan_Run();
 }
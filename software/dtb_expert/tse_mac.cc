@@ -0,0 +1,140 @@
+// tse_mac.cc
+// Frame transfer of the Triple-Speed Ethernet MAC with its transmit and
+// receive SGDMA. The driver is built for a hardware design with the MAC
+// (TSE_MAC_BASE, TSE_SGDMA_TX_NAME, TSE_SGDMA_RX_NAME in system.h),
+// otherwise tse_Init fails and the RPC interface stays on USB.
+// The MAC registers are accessed directly, the BSP TSE driver
+// (altera_avalon_tse.h) needs the InterNiche and newer register headers.
+
+#include <string.h>
+#include "system.h"
+#include "io.h"
+#include "sys/alt_cache.h"
+#include "ethernet.h"
+
+
+#ifdef TSE_MAC_BASE
+
+#include "sgdma.h"
+#include "altera_avalon_sgdma_regs.h"
+#include "triple_speed_ethernet_regs.h"
+
+
+// receive buffer size, multiple of the cache line
+#define TSE_RX_BUFFER ((ETH_FRAME_SIZE + 16 + 31) & ~31)
+
+// descriptors in descriptor_memory (budget in sgdma.h):
+// transmit head, data, end; receive ring of TSE_RX_FRAMES
+static alt_sgdma_descriptor tse_txDesc[3] __attribute__ (( section ( ".descriptor_memory" )));
+static alt_sgdma_descriptor tse_rxDesc[TSE_RX_FRAMES] __attribute__ (( section ( ".descriptor_memory" )));
+
+static alt_sgdma_dev *tse_tx;
+static alt_sgdma_dev *tse_rx;
+static uint8_t tse_rxBuffer[TSE_RX_FRAMES][TSE_RX_BUFFER] __attribute__ (( aligned (32) ));
+static uint8_t tse_rxNext; // next ring descriptor to be read
+
+
+// hand a receive descriptor back to the SGDMA, the ring links are kept
+static void tse_RxArm(uint8_t i)
+{
+	alt_sgdma_descriptor *d = tse_rxDesc + i;
+	IOWR_16DIRECT(&(d->actual_bytes_transferred), 0, 0);
+	IOWR_8DIRECT(&(d->status), 0, 0);
+	IOWR_8DIRECT(&(d->control), 0, ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_OWNED_BY_HW_MSK);
+}
+
+
+// The receive descriptors form a closed ring, the SGDMA stops at the
+// first descriptor with a frame not yet read (ring full). Frames that
+// arrive meanwhile are lost in the MAC, the RPC layer sees the gap in
+// the sequence numbers.
+static void tse_RxStart()
+{
+	for (uint8_t i = 0; i < TSE_RX_FRAMES; i++)
+		alt_avalon_sgdma_construct_stream_to_mem_desc(tse_rxDesc + i,
+			tse_rxDesc + (i + 1) % TSE_RX_FRAMES, (alt_u32*)tse_rxBuffer[i], 0, 0);
+	tse_RxArm(0); // released by the link of the last descriptor
+	tse_rxNext = 0;
+	alt_avalon_sgdma_do_async_transfer(tse_rx, tse_rxDesc);
+}
+
+
+bool tse_Init(const uint8_t *mac)
+{
+	tse_tx = alt_avalon_sgdma_open(TSE_SGDMA_TX_NAME);
+	tse_rx = alt_avalon_sgdma_open(TSE_SGDMA_RX_NAME);
+	if (!tse_tx || !tse_rx) return false;
+
+	// MAC reset, no 16 bit shift of the frames
+	IOWR_ALTERA_TSEMAC_CMD_CONFIG(TSE_MAC_BASE, ALTERA_TSEMAC_CMD_SW_RESET_MSK);
+	for (int i = 0; i < 10000; i++)
+		if (!(IORD_ALTERA_TSEMAC_CMD_CONFIG(TSE_MAC_BASE) & ALTERA_TSEMAC_CMD_SW_RESET_MSK)) break;
+	IOWR_ALTERA_TSEMAC_TX_CMD_STAT(TSE_MAC_BASE, 0);
+	IOWR_ALTERA_TSEMAC_RX_CMD_STAT(TSE_MAC_BASE, 0);
+
+	IOWR_ALTERA_TSEMAC_MAC_0(TSE_MAC_BASE,
+		mac[0] | (mac[1] << 8) | (mac[2] << 16) | (mac[3] << 24));
+	IOWR_ALTERA_TSEMAC_MAC_1(TSE_MAC_BASE, mac[4] | (mac[5] << 8));
+	IOWR_ALTERA_TSEMAC_FRM_LENGTH(TSE_MAC_BASE, ETH_FRAME_SIZE + 4);
+	IOWR_ALTERA_TSEMAC_TX_IPG_LENGTH(TSE_MAC_BASE, 12);
+
+	IOWR_ALTERA_TSEMAC_CMD_CONFIG(TSE_MAC_BASE,
+		ALTERA_TSEMAC_CMD_TX_ENA_MSK | ALTERA_TSEMAC_CMD_RX_ENA_MSK
+		| ALTERA_TSEMAC_CMD_ETH_SPEED_MSK | ALTERA_TSEMAC_CMD_PAD_EN_MSK);
+
+	tse_RxStart();
+	return true;
+}
+
+
+bool tse_Send(const void *head, uint16_t head_size, const void *data, uint16_t data_size)
+{
+	alt_dcache_flush((void*)head, head_size);
+	if (data_size)
+	{
+		alt_dcache_flush((void*)data, data_size);
+		alt_avalon_sgdma_construct_mem_to_stream_desc(tse_txDesc, tse_txDesc + 1,
+			(alt_u32*)head, head_size, 0, 1, 0, 0);
+		alt_avalon_sgdma_construct_mem_to_stream_desc(tse_txDesc + 1, tse_txDesc + 2,
+			(alt_u32*)data, data_size, 0, 0, 1, 0);
+	}
+	else alt_avalon_sgdma_construct_mem_to_stream_desc(tse_txDesc, tse_txDesc + 1,
+			(alt_u32*)head, head_size, 0, 1, 1, 0);
+
+	// waits for completion, the buffers belong to the caller
+	uint8_t status = alt_avalon_sgdma_do_sync_transfer(tse_tx, tse_txDesc);
+	return !(status & ALTERA_AVALON_SGDMA_STATUS_ERROR_MSK);
+}
+
+
+uint16_t tse_Recv(void *frame)
+{
+	alt_sgdma_descriptor *d = tse_rxDesc + tse_rxNext;
+	if (IORD_8DIRECT(&(d->control), 0)
+		& ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_OWNED_BY_HW_MSK)
+	{ // nothing received; the SGDMA stopped here if the ring was full
+		if (!(IORD_ALTERA_AVALON_SGDMA_STATUS(tse_rx->base) & ALTERA_AVALON_SGDMA_STATUS_BUSY_MSK))
+			alt_avalon_sgdma_do_async_transfer(tse_rx, d);
+		return 0;
+	}
+
+	uint16_t size = IORD_16DIRECT(&(d->actual_bytes_transferred), 0);
+	uint8_t status = IORD_8DIRECT(&(d->status), 0);
+	if (size > ETH_FRAME_SIZE) size = 0;
+	if (status & (ALTERA_AVALON_SGDMA_DESCRIPTOR_STATUS_E_CRC_MSK
+		| ALTERA_AVALON_SGDMA_DESCRIPTOR_STATUS_E_OVERFLOW_MSK)) size = 0;
+	if (size) memcpy(frame, (uint8_t*)(((unsigned long)tse_rxBuffer[tse_rxNext]) | 0x80000000), size);
+
+	tse_RxArm(tse_rxNext);
+	if (++tse_rxNext >= TSE_RX_FRAMES) tse_rxNext = 0;
+	return size;
+}
+
+
+#else // no Ethernet MAC in this hardware design
+
+bool tse_Init(const uint8_t *mac) { return false; }
+bool tse_Send(const void *head, uint16_t head_size, const void *data, uint16_t data_size) { return false; }
+uint16_t tse_Recv(void *frame) { return 0; }
+
+#endif
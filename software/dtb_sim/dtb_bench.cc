@@ -0,0 +1,881 @@
+// dtb_bench.cc
+// Benchmark driver for the DTB RPC interface (dtb_sim on a TCP socket).
+// Measures the command latency and upload rate against payload size (also
+// with the byte by byte USB read of the old firmware, Bench_UsbBytewise), the
+// download rate (Bench_Download), Daq_Read to HWvector and to vector, the
+// data generator fed DMA to USB rate of Daq_Read and of the streaming mode
+// (Daq_StreamStart, segment sequence check) and the time per point of each Loop*
+// family (Scan_GetStat), the linear and adaptive FindLevel threshold search
+// (TestColPixel) against the threshold model of dtb_sim and the granularity
+// of cDelay (GetMinTriggerSpacing). With -e the Ethernet interface (UDP
+// frames of dtb_sim, same port) is tested as well: latency and transfer
+// rates, commands alternating between USB and Ethernet (RpcIoSelect) and
+// the resync after a lost frame (ETH_RPC_START).
+// The report has one measurement per line:
+//
+//   sw_version,test,parameter,value,unit
+//
+// so that reports of two firmware releases can be compared line by line.
+//
+//   dtb_bench [-e] [-o report.csv] [port]   (default port 10100, stdout)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include "sim.h"
+#include "ethernet.h"
+
+using namespace std;
+
+
+#define BENCH_PORT    10100
+#define BENCH_REPEAT  20       // round trips per latency point
+#define BENCH_DAQ_MEM 0x100000 // DAQ memory of the read tests (words)
+#define BENCH_STREAM_TIME 1.0  // duration of the DMA to USB test (s)
+#define BENCH_STREAM_CREDITS 8 // segments on the way in the streaming test
+#define BENCH_ETH_TIMEOUT 1.0  // reply timeout on Ethernet (s)
+
+#define RPC_TYPE_DTB      0xC0
+#define RPC_TYPE_DTB_DATA 0xC2
+#define RPC_TYPE_DTB_STREAM 0xC3
+
+
+// === RPC client ===========================================================
+
+class CBenchRpc
+{
+	deque<string> stream; // stream segments received before a reply
+	uint32_t RecvHeader();
+protected:
+	int s;
+	void Fail(const char *what);
+	virtual void Send(const void *buffer, uint32_t size);
+	virtual void Recv(void *buffer, uint32_t size);
+public:
+	CBenchRpc() : s(-1) {}
+	virtual ~CBenchRpc() { if (s >= 0) close(s); }
+	bool Connect(uint16_t port);
+
+	// command id of a function name with signature, e.g. "Pg_Single$v"
+	uint16_t Id(const char *name);
+
+	// command with parameters par, followed by the vector/string
+	// parameters dat. Without reply parameters and data messages
+	// (void function without output parameters) there is no reply,
+	// otherwise replySize bytes are copied to reply and the following
+	// ndat data messages to out.
+	void Call(uint16_t id, const string &par, const vector<string> &dat,
+		void *reply, uint8_t replySize, uint16_t ndat = 0, vector<string> *out = 0);
+	void Call(uint16_t id, const string &par)
+	{ Call(id, par, vector<string>(), 0, 0); }
+	void Call(uint16_t id, const string &par, void *reply, uint8_t replySize,
+		uint16_t ndat = 0, vector<string> *out = 0)
+	{ Call(id, par, vector<string>(), reply, replySize, ndat, out); }
+
+	// next stream message (segment word + data), false after timeout s
+	bool Segment(string &seg, double timeout);
+};
+
+
+void CBenchRpc::Fail(const char *what)
+{
+	fprintf(stderr, "dtb_bench: %s\n", what);
+	exit(1);
+}
+
+
+bool CBenchRpc::Connect(uint16_t port)
+{
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s < 0) return false;
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(s, (sockaddr*)&addr, sizeof(addr)) < 0) return false;
+	int one = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	int rxsize = 16 << 20;
+	setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rxsize, sizeof(rxsize));
+	return true;
+}
+
+
+void CBenchRpc::Send(const void *buffer, uint32_t size)
+{
+	const char *p = (const char*)buffer;
+	while (size)
+	{
+		ssize_t n = send(s, p, size, 0);
+		if (n <= 0) Fail("connection lost");
+		p += n;
+		size -= n;
+	}
+}
+
+
+void CBenchRpc::Recv(void *buffer, uint32_t size)
+{
+	char *p = (char*)buffer;
+	while (size)
+	{
+		ssize_t n = recv(s, p, size, 0);
+		if (n <= 0) Fail("connection lost");
+		p += n;
+		size -= n;
+	}
+}
+
+
+static void Put32(string &s, uint32_t x)
+{
+	for (int i = 0; i < 4; i++) s += char(x >> (8*i));
+}
+
+
+// header of the next message, stream messages are queued for Segment
+uint32_t CBenchRpc::RecvHeader()
+{
+	uint32_t hdr;
+	Recv(&hdr, 4);
+	while ((hdr & 0xff) == RPC_TYPE_DTB_STREAM)
+	{
+		stream.push_back(string(hdr >> 8, 0));
+		if (hdr >> 8) Recv(&stream.back()[0], hdr >> 8);
+		Recv(&hdr, 4);
+	}
+	return hdr;
+}
+
+
+bool CBenchRpc::Segment(string &seg, double timeout)
+{
+	if (stream.empty())
+	{
+		fd_set rd;
+		FD_ZERO(&rd);
+		FD_SET(s, &rd);
+		timeval t = { long(timeout), long((timeout - long(timeout))*1e6) };
+		if (select(s + 1, &rd, 0, 0, &t) <= 0) return false;
+
+		uint32_t hdr;
+		Recv(&hdr, 4);
+		if ((hdr & 0xff) != RPC_TYPE_DTB_STREAM) Fail("stream message expected");
+		seg.resize(hdr >> 8);
+		if (seg.size()) Recv(&seg[0], seg.size());
+		return true;
+	}
+	seg = stream.front();
+	stream.pop_front();
+	return true;
+}
+
+
+void CBenchRpc::Call(uint16_t id, const string &par, const vector<string> &dat,
+	void *reply, uint8_t replySize, uint16_t ndat, vector<string> *out)
+{
+	string msg;
+	Put32(msg, RPC_TYPE_DTB | (uint32_t(id) << 8) | (uint32_t(par.size()) << 24));
+	msg += par;
+	for (unsigned int i = 0; i < dat.size(); i++)
+	{
+		Put32(msg, RPC_TYPE_DTB_DATA | (uint32_t(dat[i].size()) << 8));
+		msg += dat[i];
+	}
+	Send(msg.data(), msg.size());
+	if (replySize == 0 && ndat == 0) return;
+
+	uint32_t hdr = RecvHeader();
+	if ((hdr & 0xff) != RPC_TYPE_DTB || ((hdr >> 8) & 0xffff) != id
+		|| (hdr >> 24) != replySize) Fail("unexpected reply");
+	Recv(reply, replySize);
+
+	if (out) out->resize(ndat);
+	for (uint16_t i = 0; i < ndat; i++)
+	{
+		hdr = RecvHeader();
+		if ((hdr & 0xff) != RPC_TYPE_DTB_DATA) Fail("data message expected");
+		string &d = (*out)[i];
+		d.resize(hdr >> 8);
+		if (d.size()) Recv(&d[0], d.size());
+	}
+}
+
+
+uint16_t CBenchRpc::Id(const char *name)
+{
+	// GetRpcCallId$i3c has the fixed id 1
+	vector<string> dat(1, name);
+	int32_t id;
+	Call(1, "", dat, &id, 4);
+	if (id < 0)
+	{
+		fprintf(stderr, "dtb_bench: %s not implemented\n", name);
+		exit(1);
+	}
+	return id;
+}
+
+
+// === RPC client on Ethernet ==============================================
+
+// The RPC byte stream in Ethernet frames (ethernet.h), one frame per UDP
+// datagram of dtb_sim. Each message starts a new frame with ETH_RPC_START.
+class CBenchEth : public CBenchRpc
+{
+	uint16_t txSeq, rxSeq;
+	bool rxFirst;
+	int drop;     // frame of the next message that is not sent, -1 = none
+	string rx;    // received data, read from rxPos
+	size_t rxPos;
+	bool Frame(double timeout);
+	void Send(const void *buffer, uint32_t size);
+	void Recv(void *buffer, uint32_t size);
+public:
+	uint32_t rxLost;  // sequence gaps of the board's frames
+	CBenchEth() : txSeq(0), rxSeq(0), rxFirst(true), drop(-1), rxPos(0), rxLost(0) {}
+	bool Connect(uint16_t port);
+
+	// loses frame n of the next message (n = 0: the ETH_RPC_START frame)
+	void DropFrame(int n) { drop = n; }
+	// true if data arrives within timeout s
+	bool Pending(double timeout) { return rxPos < rx.size() || Frame(timeout); }
+};
+
+
+static const uint8_t bench_dtb_mac[ETH_ADDR_SIZE]  = { 0x02, 0x00, 0x00, 0x00, 0xd7, 0xb0 };
+static const uint8_t bench_host_mac[ETH_ADDR_SIZE] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+
+bool CBenchEth::Connect(uint16_t port)
+{
+	s = socket(AF_INET, SOCK_DGRAM, 0);
+	if (s < 0) return false;
+	int rxsize = 16 << 20;
+	setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rxsize, sizeof(rxsize));
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	return connect(s, (sockaddr*)&addr, sizeof(addr)) == 0;
+}
+
+
+void CBenchEth::Send(const void *buffer, uint32_t size)
+{
+	const uint8_t *p = (const uint8_t*)buffer;
+	for (int i = 0; size; i++)
+	{
+		uint16_t n = (size > ETH_DATA_SIZE) ? ETH_DATA_SIZE : size;
+		uint16_t head = n | ((i == 0) ? ETH_RPC_START : 0);
+		uint8_t frame[ETH_FRAME_SIZE];
+		memcpy(frame, bench_dtb_mac, ETH_ADDR_SIZE);
+		memcpy(frame + ETH_ADDR_SIZE, bench_host_mac, ETH_ADDR_SIZE);
+		frame[12] = uint8_t(ETH_RPC_TYPE >> 8);
+		frame[13] = uint8_t(ETH_RPC_TYPE);
+		frame[14] = uint8_t(head);
+		frame[15] = uint8_t(head >> 8);
+		frame[16] = uint8_t(txSeq);
+		frame[17] = uint8_t(txSeq >> 8);
+		memcpy(frame + ETH_HEAD_SIZE, p, n);
+		txSeq++;
+
+		uint16_t len = ETH_HEAD_SIZE + n;
+		while (len < ETH_MIN_FRAME) frame[len++] = 0;
+		if (i != drop && send(s, frame, len, 0) != len) Fail("Ethernet send failed");
+		p += n;
+		size -= n;
+	}
+	drop = -1;
+}
+
+
+// one frame of the board, its RPC data is appended to rx
+bool CBenchEth::Frame(double timeout)
+{
+	fd_set rd;
+	FD_ZERO(&rd);
+	FD_SET(s, &rd);
+	timeval t = { long(timeout), long((timeout - long(timeout))*1e6) };
+	if (select(s + 1, &rd, 0, 0, &t) <= 0) return false;
+
+	uint8_t frame[ETH_FRAME_SIZE];
+	ssize_t size = recv(s, frame, sizeof(frame), 0);
+	if (size < ETH_HEAD_SIZE
+		|| ((frame[12] << 8) | frame[13]) != ETH_RPC_TYPE
+		|| memcmp(frame, bench_host_mac, ETH_ADDR_SIZE) != 0) Fail("unexpected Ethernet frame");
+	uint16_t n = frame[14] | (frame[15] << 8);
+	uint16_t seq = frame[16] | (frame[17] << 8);
+	if (n > size - ETH_HEAD_SIZE) Fail("Ethernet frame too short");
+	if (!rxFirst && seq != rxSeq) rxLost++;
+	rxFirst = false;
+	rxSeq = seq + 1;
+
+	if (rxPos == rx.size()) { rx.clear(); rxPos = 0; }
+	rx.append((const char*)frame + ETH_HEAD_SIZE, n);
+	return true;
+}
+
+
+void CBenchEth::Recv(void *buffer, uint32_t size)
+{
+	while (rx.size() - rxPos < size)
+		if (!Frame(BENCH_ETH_TIMEOUT)) Fail("no reply on Ethernet");
+	memcpy(buffer, rx.data() + rxPos, size);
+	rxPos += size;
+}
+
+
+// === parameters ===========================================================
+
+class Par
+{
+	string s;
+public:
+	Par &u8(uint8_t x)   { s += char(x); return *this; }
+	Par &u16(uint16_t x) { s += char(x); s += char(x >> 8); return *this; }
+	Par &u32(uint32_t x) { Put32(s, x); return *this; }
+	operator const string&() const { return s; }
+};
+
+
+static double Now()
+{
+	timeval t;
+	gettimeofday(&t, 0);
+	return t.tv_sec + t.tv_usec*1e-6;
+}
+
+
+// === benchmark ============================================================
+
+class CBench
+{
+	CBenchRpc &rpc;
+	FILE *f;
+	char sw[8];
+	void Report(const char *test, const char *param, double value, const char *unit);
+public:
+	CBench(CBenchRpc &r, FILE *report) : rpc(r), f(report) {}
+	void Version();
+	void Latency();
+	void Download();
+	void DaqRead();
+	void DaqStream();
+	void Loops();
+	void FindLevel();
+	void Delay();
+	void Ethernet(CBenchEth &eth);
+};
+
+
+void CBench::Report(const char *test, const char *param, double value, const char *unit)
+{
+	fprintf(f, "%s,%s,%s,%.3f,%s\n", sw, test, param, value, unit);
+	fflush(f);
+}
+
+
+void CBench::Version()
+{
+	uint16_t v;
+	rpc.Call(rpc.Id("GetSWVersion$S"), "", &v, 2);
+	sprintf(sw, "%u.%u", v >> 8, v & 0xff);
+	fprintf(f, "sw_version,test,parameter,value,unit\n");
+}
+
+
+// round trip of Bench_Upload against payload size, upload rate of the
+// burst read and of the byte by byte read (reference)
+void CBench::Latency()
+{
+	uint16_t upload = rpc.Id("Bench_Upload$I1S");
+	uint16_t bytewise = rpc.Id("Bench_UsbBytewise$vb");
+	static const uint32_t size[] = { 0, 64, 256, 1024, 4096, 16384, 65536, 262144 };
+	for (int old = 0; old <= 1; old++)
+	{
+		rpc.Call(bytewise, Par().u8(old));
+		for (unsigned int k = 0; k < sizeof(size)/sizeof(size[0]); k++)
+		{
+			vector<string> dat(1, string(size[k], 'x'));
+			uint32_t words;
+			double t = Now();
+			for (int i = 0; i < BENCH_REPEAT; i++)
+				rpc.Call(upload, "", dat, &words, 4);
+			t = (Now() - t)/BENCH_REPEAT;
+
+			char param[32];
+			sprintf(param, "%u bytes", size[k]);
+			Report(old ? "latency_bytewise" : "latency", param, t*1e6, "us");
+			if (size[k] >= 4096)
+				Report(old ? "upload_bytewise" : "upload", param, size[k]/t*1e-6, "MB/s");
+		}
+	}
+	rpc.Call(bytewise, Par().u8(0));
+}
+
+
+// zero copy source against transfer size
+void CBench::Download()
+{
+	uint16_t download = rpc.Id("Bench_Download$vI5S");
+	static const uint32_t words[] = { 512, 4096, 32768, 262144, 524288 };
+	for (unsigned int k = 0; k < sizeof(words)/sizeof(words[0]); k++)
+	{
+		vector<string> out;
+		uint32_t bytes = 0;
+		double t = Now();
+		for (int i = 0; i < BENCH_REPEAT; i++)
+		{
+			rpc.Call(download, Par().u32(words[k]), 0, 0, 1, &out);
+			bytes += out[0].size();
+		}
+		t = Now() - t;
+
+		char param[32];
+		sprintf(param, "%u words", words[k]);
+		Report("download", param, bytes/t*1e-6, "MB/s");
+	}
+}
+
+
+// Daq_Read of data generator events to HWvector (zero copy) and vector
+void CBench::DaqRead()
+{
+	uint16_t open = rpc.Id("Daq_Open$IIC");
+	uint16_t close = rpc.Id("Daq_Close$vC");
+	uint16_t start = rpc.Id("Daq_Start$vC");
+	uint16_t size = rpc.Id("Daq_GetSize$IC");
+	uint16_t datagen = rpc.Id("Daq_Select_Datagenerator$vS");
+	uint16_t setcmd = rpc.Id("Pg_SetCmd$vSS");
+	uint16_t triggers = rpc.Id("Pg_Triggers$vIS");
+	uint16_t readHw = rpc.Id("Daq_Read$C5SIC");
+	uint16_t readVec = rpc.Id("Daq_Read$C2SIC");
+
+	uint32_t mem;
+	rpc.Call(open, Par().u32(BENCH_DAQ_MEM).u8(0), &mem, 4);
+	if (mem < BENCH_DAQ_MEM) { fprintf(stderr, "dtb_bench: Daq_Open failed\n"); return; }
+	rpc.Call(datagen, Par().u16(0));
+	rpc.Call(setcmd, Par().u16(0).u16(0x0100));
+	rpc.Call(start, Par().u8(0));
+
+	static const uint32_t words[] = { 4096, 32768, 262144 };
+	for (unsigned int k = 0; k < sizeof(words)/sizeof(words[0]); k++)
+	{
+		for (int hw = 1; hw >= 0; hw--)
+		{
+			uint32_t bytes = 0;
+			double t = 0;
+			for (int i = 0; i < BENCH_REPEAT/4; i++)
+			{
+				uint32_t n;
+				do
+				{
+					rpc.Call(triggers, Par().u32(words[k]/4).u16(0));
+					rpc.Call(size, Par().u8(0), &n, 4);
+				} while (n < words[k]);
+
+				vector<string> out;
+				uint8_t status;
+				double t0 = Now();
+				rpc.Call(hw ? readHw : readVec, Par().u32(words[k]).u8(0), &status, 1, 1, &out);
+				t += Now() - t0;
+				bytes += out[0].size();
+
+				// discard the rest
+				rpc.Call(readHw, Par().u32(BENCH_DAQ_MEM).u8(0), &status, 1, 1, &out);
+			}
+
+			char param[32];
+			sprintf(param, "%u words", words[k]);
+			Report(hw ? "daq_read_hwvector" : "daq_read_vector", param, bytes/t*1e-6, "MB/s");
+		}
+	}
+	rpc.Call(close, Par().u8(0));
+}
+
+
+// data generator in loop mode, read continuously: DMA to USB rate of
+// Daq_Read and of the streaming mode, one credit returned per segment.
+// daq_stream_seq_errors counts gaps in the segment sequence numbers and
+// a difference to the segments and bytes reported by Daq_StreamStop.
+void CBench::DaqStream()
+{
+	uint16_t open = rpc.Id("Daq_Open$IIC");
+	uint16_t close = rpc.Id("Daq_Close$vC");
+	uint16_t start = rpc.Id("Daq_Start$vC");
+	uint16_t stop = rpc.Id("Daq_Stop$vC");
+	uint16_t datagen = rpc.Id("Daq_Select_Datagenerator$vS");
+	uint16_t setcmd = rpc.Id("Pg_SetCmd$vSS");
+	uint16_t loop = rpc.Id("Pg_Loop$vS");
+	uint16_t pgstop = rpc.Id("Pg_Stop$v");
+	uint16_t read = rpc.Id("Daq_Read$C5SIC");
+	uint16_t streamStart = rpc.Id("Daq_StreamStart$bCIS");
+	uint16_t streamCredit = rpc.Id("Daq_StreamCredit$vS");
+	uint16_t streamStop = rpc.Id("Daq_StreamStop$I0I0I");
+
+	static const uint16_t period[] = { 400, 100, 40 };
+	for (unsigned int k = 0; k < sizeof(period)/sizeof(period[0]); k++)
+	{
+		char param[32];
+		sprintf(param, "period %u", period[k]);
+
+		for (int streaming = 0; streaming <= 1; streaming++)
+		{
+			uint32_t mem;
+			rpc.Call(open, Par().u32(BENCH_DAQ_MEM).u8(0), &mem, 4);
+			rpc.Call(datagen, Par().u16(0));
+			rpc.Call(setcmd, Par().u16(0).u16(0x0100));
+			rpc.Call(start, Par().u8(0));
+			if (streaming)
+			{
+				uint8_t ok;
+				rpc.Call(streamStart, Par().u8(1).u32(0x8000).u16(BENCH_STREAM_CREDITS), &ok, 1);
+				if (!ok) { fprintf(stderr, "dtb_bench: Daq_StreamStart failed\n"); return; }
+			}
+			rpc.Call(loop, Par().u16(period[k]));
+
+			uint64_t bytes = 0, streamed = 0;
+			uint8_t status = 0, statusOr = 0;
+			uint32_t segments = 0, seqErrors = 0;
+			uint16_t seq = 0;
+			string seg;
+			double t0 = Now(), t;
+			do
+			{
+				if (streaming)
+				{
+					if (rpc.Segment(seg, BENCH_STREAM_TIME))
+					{
+						uint32_t w;
+						memcpy(&w, seg.data(), 4);
+						if ((w >> 16) != seq) seqErrors++;
+						seq = (w >> 16) + 1;
+						statusOr |= w >> 8;
+						bytes += seg.size() - 4;
+						segments++;
+						rpc.Call(streamCredit, Par().u16(1));
+					}
+				}
+				else
+				{
+					vector<string> out;
+					rpc.Call(read, Par().u32(0x8000).u8(0), &status, 1, 1, &out);
+					bytes += out[0].size();
+					statusOr |= status;
+				}
+				t = Now() - t0;
+			} while (t < BENCH_STREAM_TIME);
+			rpc.Call(pgstop, "");
+
+			if (streaming)
+			{ // segments sent before the reply are queued by Call
+				struct { uint32_t count, bytes, ms; } __attribute__ ((packed)) r;
+				rpc.Call(streamStop, Par().u32(0).u32(0), &r, 12);
+				while (rpc.Segment(seg, 0))
+				{
+					uint32_t w;
+					memcpy(&w, seg.data(), 4);
+					if ((w >> 16) != seq) seqErrors++;
+					seq = (w >> 16) + 1;
+					streamed += seg.size() - 4;
+					segments++;
+				}
+				// all segments sent by the firmware arrived
+				streamed += bytes;
+				if (segments != r.count || streamed != r.bytes) seqErrors++;
+			}
+			rpc.Call(stop, Par().u8(0));
+			rpc.Call(close, Par().u8(0));
+
+			if (streaming)
+			{
+				Report("daq_stream", param, bytes/t*1e-6, "MB/s");
+				Report("daq_stream_status", param, statusOr & 0xff, "");
+				Report("daq_stream_seq_errors", param, seqErrors, "");
+			}
+			else
+			{
+				Report("dma_usb", param, bytes/t*1e-6, "MB/s");
+				Report("dma_usb_status", param, statusOr, "");
+			}
+		}
+	}
+}
+
+
+// time per point of each Loop* family
+void CBench::Loops()
+{
+	uint16_t stat = rpc.Id("Scan_GetStat$I0I");
+	const uint8_t roc = 0, col = 10, row = 20, vcal = 25, vthr = 12;
+	const uint16_t ntrig = 1, flags = 0;
+	vector<string> rocs(1, string(1, char(roc)));
+
+	struct Loop
+	{
+		const char *name;
+		bool multi;
+		Par par;
+	} loops[] =
+	{
+		{ "LoopSingleRocAllPixelsCalibrate$bCSS", false,
+			Par().u8(roc).u16(ntrig).u16(flags) },
+		{ "LoopSingleRocOnePixelCalibrate$bCCCSS", false,
+			Par().u8(roc).u8(col).u8(row).u16(ntrig).u16(flags) },
+		{ "LoopMultiRocAllPixelsCalibrate$b1CSS", true,
+			Par().u16(ntrig).u16(flags) },
+		{ "LoopMultiRocOnePixelCalibrate$b1CCCSS", true,
+			Par().u8(col).u8(row).u16(ntrig).u16(flags) },
+		{ "LoopSingleRocAllPixelsDacScan$bCSSCCC", false,
+			Par().u8(roc).u16(ntrig).u16(flags).u8(vcal).u8(0).u8(3) },
+		{ "LoopSingleRocOnePixelDacScan$bCCCSSCCC", false,
+			Par().u8(roc).u8(col).u8(row).u16(ntrig).u16(flags).u8(vcal).u8(0).u8(99) },
+		{ "LoopMultiRocAllPixelsDacScan$b1CSSCCC", true,
+			Par().u16(ntrig).u16(flags).u8(vcal).u8(0).u8(3) },
+		{ "LoopMultiRocOnePixelDacScan$b1CCCSSCCC", true,
+			Par().u8(col).u8(row).u16(ntrig).u16(flags).u8(vcal).u8(0).u8(99) },
+		{ "LoopSingleRocAllPixelsDacDacScan$bCSSCCCCCC", false,
+			Par().u8(roc).u16(ntrig).u16(flags).u8(vcal).u8(0).u8(1).u8(vthr).u8(0).u8(1) },
+		{ "LoopSingleRocOnePixelDacDacScan$bCCCSSCCCCCC", false,
+			Par().u8(roc).u8(col).u8(row).u16(ntrig).u16(flags).u8(vcal).u8(0).u8(9).u8(vthr).u8(0).u8(9) },
+		{ "LoopMultiRocAllPixelsDacDacScan$b1CSSCCCCCC", true,
+			Par().u16(ntrig).u16(flags).u8(vcal).u8(0).u8(1).u8(vthr).u8(0).u8(1) },
+		{ "LoopMultiRocOnePixelDacDacScan$b1CCCSSCCCCCC", true,
+			Par().u8(col).u8(row).u16(ntrig).u16(flags).u8(vcal).u8(0).u8(9).u8(vthr).u8(0).u8(9) }
+	};
+
+	for (unsigned int k = 0; k < sizeof(loops)/sizeof(loops[0]); k++)
+	{
+		Loop &l = loops[k];
+		uint16_t id = rpc.Id(l.name);
+		vector<string> dat;
+		if (l.multi) dat = rocs;
+
+		// an interrupted loop is resumed by the same call
+		uint8_t done;
+		do rpc.Call(id, l.par, dat, &done, 1); while (!done);
+
+		struct { uint32_t us, points; } __attribute__ ((packed)) r;
+		rpc.Call(stat, Par().u32(0), &r, 8);
+
+		string family(l.name, strchr(l.name, '$') - l.name);
+		Report(family.c_str(), "points", r.points, "");
+		Report(family.c_str(), "time per point", r.points ? double(r.us)/r.points : 0, "us");
+	}
+}
+
+
+// TestColPixel with the linear and the adaptive threshold search: GetPixel
+// calls (steps) per pixel and deviation from the model threshold of dtb_sim
+// (sim_Threshold, limited to 1..253 like FindLevel). Each column has its
+// own trim value to spread the thresholds.
+void CBench::FindLevel()
+{
+	uint16_t open = rpc.Id("Daq_Open$IIC");
+	uint16_t close = rpc.Id("Daq_Close$vC");
+	uint16_t deser160 = rpc.Id("Daq_Select_Deser160$vC");
+	uint16_t setcmd = rpc.Id("Pg_SetCmd$vSS");
+	uint16_t i2caddr = rpc.Id("roc_I2cAddr$vC");
+	uint16_t setdac = rpc.Id("roc_SetDAC$vCC");
+	uint16_t mode = rpc.Id("SetFindLevelMode$vC");
+	uint16_t steps = rpc.Id("GetFindLevelSteps$Ib");
+	uint16_t test = rpc.Id("TestColPixel$bCCb2C");
+
+	const uint8_t vthrcomp = 100;
+	static const uint8_t col[] = { 0, 17, 34, 51 };
+	static const uint8_t trim[] = { 0, 5, 10, 15 };
+	static const char *name[] = { "linear", "adaptive" };
+
+	uint32_t mem;
+	rpc.Call(open, Par().u32(BENCH_DAQ_MEM).u8(0), &mem, 4);
+	rpc.Call(deser160, Par().u8(4));
+	rpc.Call(setcmd, Par().u16(0).u16(0x0400 | 20)); // PG_CAL
+	rpc.Call(setcmd, Par().u16(1).u16(0x0300));      // PG_TRG + PG_TOK
+	rpc.Call(i2caddr, Par().u8(0));
+	rpc.Call(setdac, Par().u8(12).u8(vthrcomp));     // VthrComp
+
+	for (uint8_t m = 0; m < 2; m++)
+	{
+		uint32_t n;
+		rpc.Call(mode, Par().u8(m));
+		rpc.Call(steps, Par().u8(1), &n, 4);
+
+		uint32_t pixels = 0, errors = 0, maxError = 0, errorSum = 0;
+		double t = Now();
+		for (unsigned int k = 0; k < sizeof(col); k++)
+		{
+			vector<string> out;
+			uint8_t ok;
+			rpc.Call(test, Par().u8(col[k]).u8(trim[k]).u8(0), &ok, 1, 1, &out);
+			if (!ok) errors++;
+			for (unsigned int row = 0; row < out[0].size(); row++)
+			{
+				int32_t thr = sim_Threshold(trim[k], vthrcomp, col[k], row);
+				if (thr < 1) thr = 1; else if (thr > 253) thr = 253;
+				uint32_t e = abs(int32_t(uint8_t(out[0][row])) - thr);
+				errorSum += e;
+				if (e > maxError) maxError = e;
+				pixels++;
+			}
+		}
+		t = Now() - t;
+		rpc.Call(steps, Par().u8(0), &n, 4);
+
+		char param[48];
+		sprintf(param, "%s steps per pixel", name[m]);
+		Report("findlevel", param, pixels ? double(n)/pixels : 0, "");
+		sprintf(param, "%s mean threshold error", name[m]);
+		Report("findlevel", param, pixels ? double(errorSum)/pixels : 0, "Vcal");
+		sprintf(param, "%s max threshold error", name[m]);
+		Report("findlevel", param, maxError, "Vcal");
+		sprintf(param, "%s time per pixel", name[m]);
+		Report("findlevel", param, pixels ? t/pixels*1e6 : 0, "us");
+		sprintf(param, "%s failed columns", name[m]);
+		Report("findlevel", param, errors, "");
+	}
+	rpc.Call(mode, Par().u8(1));
+	rpc.Call(close, Par().u8(0));
+}
+
+
+// cDelay(1) + Pg_Single fence at 40 MHz: one polling pass of Wait_clk
+void CBench::Delay()
+{
+	rpc.Call(rpc.Id("Pon$v"), "");
+	uint16_t ns;
+	rpc.Call(rpc.Id("GetMinTriggerSpacing$S"), "", &ns, 2);
+	rpc.Call(rpc.Id("Poff$v"), "");
+	Report("delay", "cDelay(1) + fence", ns, "ns");
+}
+
+
+// Ethernet: latency and transfer rates, commands alternating between USB
+// and Ethernet (RpcIoSelect), a message with a lost frame must be dropped
+// and the next message (ETH_RPC_START) answered
+void CBench::Ethernet(CBenchEth &eth)
+{
+	uint16_t version = rpc.Id("GetSWVersion$S");
+	uint16_t upload = rpc.Id("Bench_Upload$I1S");
+	uint16_t download = rpc.Id("Bench_Download$vI5S");
+	uint16_t stat = rpc.Id("Ethernet_GetStat$I0I0I");
+
+	static const uint32_t size[] = { 0, 1024, 16384, 65536 };
+	for (unsigned int k = 0; k < sizeof(size)/sizeof(size[0]); k++)
+	{
+		vector<string> dat(1, string(size[k], 'x'));
+		uint32_t words;
+		double t = Now();
+		for (int i = 0; i < BENCH_REPEAT; i++)
+			eth.Call(upload, "", dat, &words, 4);
+		t = (Now() - t)/BENCH_REPEAT;
+
+		char param[32];
+		sprintf(param, "%u bytes", size[k]);
+		Report("eth_latency", param, t*1e6, "us");
+		if (size[k] >= 16384) Report("eth_upload", param, size[k]/t*1e-6, "MB/s");
+	}
+
+	vector<string> out;
+	double t = Now();
+	for (int i = 0; i < BENCH_REPEAT; i++)
+		eth.Call(download, Par().u32(32768), 0, 0, 1, &out);
+	t = Now() - t;
+	Report("eth_download", "32768 words", BENCH_REPEAT*65536/t*1e-6, "MB/s");
+
+	// each command switches the interface
+	uint16_t vUsb, vEth;
+	int wrong = 0;
+	t = Now();
+	for (int i = 0; i < BENCH_REPEAT; i++)
+	{
+		rpc.Call(version, "", &vUsb, 2);
+		eth.Call(version, "", &vEth, 2);
+		if (vUsb != vEth) wrong++;
+	}
+	t = (Now() - t)/(2*BENCH_REPEAT);
+	Report("eth_switch", "USB/Ethernet", t*1e6, "us");
+	Report("eth_switch", "wrong replies", wrong, "");
+
+	// Bench_Upload of 4 frames, the second one is lost
+	uint32_t lost0, lost1, sent, stats[3];
+	eth.Call(stat, Par().u32(0).u32(0), stats, 12);
+	lost0 = stats[1];
+	vector<string> dat(1, string(3*ETH_DATA_SIZE, 'x'));
+	eth.DropFrame(1);
+	eth.Call(upload, "", dat, 0, 0);
+	bool reply = eth.Pending(BENCH_ETH_TIMEOUT);
+	Report("eth_lost_frame", "reply to broken message", reply, "");
+	eth.Call(version, "", &vEth, 2); // fails without reply
+	Report("eth_lost_frame", "next command answered", vEth == vUsb, "");
+	eth.Call(stat, Par().u32(0).u32(0), stats, 12);
+	lost1 = stats[1];
+	sent = stats[2];
+	Report("eth_lost_frame", "frames lost (board)", lost1 - lost0, "");
+	Report("eth_lost_frame", "frames lost (host)", eth.rxLost, "");
+	Report("eth_lost_frame", "frames sent (board)", sent, "");
+}
+
+
+// === main =================================================================
+
+int main(int argc, char *argv[])
+{
+	uint16_t port = BENCH_PORT;
+	bool ethernet = false;
+	FILE *f = stdout;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-e") == 0) ethernet = true;
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+		{
+			f = fopen(argv[++i], "w");
+			if (!f) { printf("cannot open %s\n", argv[i]); return 1; }
+		}
+		else port = atoi(argv[i]);
+	}
+
+	CBenchRpc rpc;
+	if (!rpc.Connect(port))
+	{
+		printf("cannot connect to port %u\n", port);
+		return 1;
+	}
+
+	CBench bench(rpc, f);
+	bench.Version();
+	bench.Latency();
+	bench.Download();
+	bench.DaqRead();
+	bench.DaqStream();
+	bench.Loops();
+	bench.FindLevel();
+	bench.Delay();
+
+	if (ethernet)
+	{
+		CBenchEth eth;
+		if (!eth.Connect(port))
+		{
+			printf("cannot open UDP port %u\n", port);
+			return 1;
+		}
+		bench.Ethernet(eth);
+	}
+
+	if (f != stdout) fclose(f);
+	return 0;
+}
@@ -0,0 +1,20 @@
+// io.h
+// I/O macros of the host build: the HAL io.h with the register address
+// computed as an integer. The 32 bit bus addresses of system.h are not
+// pointer sized on the host, the HAL casts them to a pointer directly.
+
+#ifndef SIM_IO_MACROS_H
+#define SIM_IO_MACROS_H
+
+#include <stdint.h>
+#include_next "io.h"
+
+#undef __IO_CALC_ADDRESS_DYNAMIC
+#define __IO_CALC_ADDRESS_DYNAMIC(BASE, OFFSET) \
+	((void *)((uintptr_t)(BASE) + (OFFSET)))
+
+#undef __IO_CALC_ADDRESS_NATIVE
+#define __IO_CALC_ADDRESS_NATIVE(BASE, REGNUM) \
+	((void *)((uintptr_t)(BASE) + ((REGNUM) * (SYSTEM_BUS_WIDTH/8))))
+
+#endif
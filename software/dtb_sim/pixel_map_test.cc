@@ -0,0 +1,195 @@
+// pixel_map_test.cc
+// Host check of the pixel map decoder (pixel_map.cc) with recorded data:
+// the DESER160 and DESER400 blocks of pixel_map_test.dat are decoded bin
+// by bin, then the event and error counts, the hits of every pixel and
+// the thresholds of the efficiency curves (1/16 bin) are compared with
+// the expected values of the file. Threshold is also checked with
+// constructed curves (interpolation, falling curve, no crossing).
+//
+//   pixel_map_test [pixel_map_test.dat]   (exit code 0 if all checks pass)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "pixel_map.h"
+
+
+#define TEST_FILE     "pixel_map_test.dat"
+#define TEST_MAXWORDS 64  // data words per line
+
+
+static int failures = 0;
+static int line = 0;
+
+static void Fail(const char *format, ...)
+{
+	va_list ap;
+	va_start(ap, format);
+	printf("line %i: ", line);
+	vprintf(format, ap);
+	printf("\n");
+	va_end(ap);
+	failures++;
+}
+
+
+// === Threshold ============================================================
+
+static void CheckThreshold(const char *name, const uint8_t *curve, uint16_t bins,
+	uint8_t ntrig, uint16_t expected)
+{
+	uint16_t t = CPixelMap::Threshold(curve, bins, ntrig);
+	if (t != expected) Fail("Threshold %s: %u, expected %u", name, t, expected);
+}
+
+
+static void CheckThresholds()
+{
+	static const uint8_t rising[]  = { 0, 2, 4, 8, 10, 10 };
+	static const uint8_t falling[] = { 10, 10, 6, 3, 0 };
+	static const uint8_t half[]    = { 0, 1, 5, 10 };
+	static const uint8_t low[]     = { 0, 1, 2, 3 };
+
+	CheckThreshold("rising", rising, sizeof(rising), 10, 2*16 + 4);
+	CheckThreshold("falling", falling, sizeof(falling), 10, 2*16 + 5);
+	CheckThreshold("50% in bin", half, sizeof(half), 10, 2*16);
+	CheckThreshold("no crossing", low, sizeof(low), 10, PIXMAP_NO_THRESHOLD);
+	CheckThreshold("one bin", rising, 1, 10, PIXMAP_NO_THRESHOLD);
+	CheckThreshold("no triggers", rising, sizeof(rising), 0, PIXMAP_NO_THRESHOLD);
+}
+
+
+// === recorded data ========================================================
+
+static CPixelMap map;
+static uint16_t bins = 0;
+static uint8_t ntrig = 0;
+static uint16_t expect[PIXMAP_MAXROCS*PIXMAP_NUMPIXELS];  // hits
+
+
+static bool Pixel(const char *args, uint32_t &i, uint32_t &value)
+{
+	unsigned int roc, col, row;
+	if (sscanf(args, "%u %u %u %u", &roc, &col, &row, &value) != 4
+		|| roc >= map.GetRocs() || col >= PIXMAP_NUMCOLS || row >= PIXMAP_NUMROWS)
+	{
+		Fail("invalid pixel");
+		return false;
+	}
+	i = roc*PIXMAP_NUMPIXELS + col*PIXMAP_NUMROWS + row;
+	return true;
+}
+
+
+// all pixels against the expected hits, efficiency curves add up to the hits
+static void CheckHits()
+{
+	for (uint32_t i = 0; i < uint32_t(map.GetRocs())*PIXMAP_NUMPIXELS; i++)
+	{
+		uint16_t roc = i/PIXMAP_NUMPIXELS, pixel = i%PIXMAP_NUMPIXELS;
+		uint16_t hits = map.GetHits(roc)[pixel];
+		if (hits != expect[i])
+			Fail("roc %u col %u row %u: %u hits, expected %u", roc,
+				pixel/PIXMAP_NUMROWS, pixel%PIXMAP_NUMROWS, hits, expect[i]);
+		if (bins < 2) continue;
+
+		const uint8_t *curve = map.GetEff(roc) + pixel*bins;
+		uint32_t sum = 0;
+		for (uint16_t k = 0; k < bins; k++) sum += curve[k];
+		if (sum != hits)
+			Fail("roc %u col %u row %u: efficiency curve sum %u, hits %u", roc,
+				pixel/PIXMAP_NUMROWS, pixel%PIXMAP_NUMROWS, sum, hits);
+	}
+}
+
+
+static void Command(const char *cmd, const char *args)
+{
+	if (strcmp(cmd, "map") == 0)
+	{
+		char format[16], option[16] = "";
+		unsigned int rocs, perChannel, b, n;
+		if (sscanf(args, "%15s %u %u %u %u %15s", format, &rocs, &perChannel, &b, &n, option) < 5)
+		{ Fail("invalid map"); return; }
+		bins = b;
+		ntrig = n;
+		if (!map.Init(rocs, perChannel, strcmp(format, "deser400") == 0,
+			strcmp(option, "inverted") == 0, bins)) Fail("Init failed");
+		memset(expect, 0, sizeof(expect));
+	}
+	else if (map.GetRocs() == 0) Fail("%s without map", cmd);
+	else if (strcmp(cmd, "bin") == 0) map.SetBin(atoi(args));
+	else if (strcmp(cmd, "data") == 0)
+	{
+		uint16_t data[TEST_MAXWORDS];
+		uint32_t size = 0;
+		char *p;
+		uint8_t channel = strtoul(args, &p, 10);
+		while (size < TEST_MAXWORDS)
+		{
+			char *q;
+			unsigned long x = strtoul(p, &q, 16);
+			if (q == p) break;
+			data[size++] = x;
+			p = q;
+		}
+		map.Decode(channel, data, size);
+	}
+	else if (strcmp(cmd, "events") == 0)
+	{
+		if (map.GetEvents() != uint32_t(atoi(args)))
+			Fail("%u events, expected %s", map.GetEvents(), args);
+	}
+	else if (strcmp(cmd, "errors") == 0)
+	{
+		if (map.GetErrors() != uint32_t(atoi(args)))
+			Fail("%u errors, expected %s", map.GetErrors(), args);
+	}
+	else if (strcmp(cmd, "hits") == 0)
+	{
+		uint32_t i, n;
+		if (Pixel(args, i, n)) expect[i] = n;
+	}
+	else if (strcmp(cmd, "threshold") == 0)
+	{
+		uint32_t i, t;
+		if (!Pixel(args, i, t)) return;
+		uint16_t roc = i/PIXMAP_NUMPIXELS, pixel = i%PIXMAP_NUMPIXELS;
+		uint16_t thr = CPixelMap::Threshold(map.GetEff(roc) + pixel*bins, bins, ntrig);
+		if (thr != t) Fail("threshold %u, expected %u", thr, t);
+	}
+	else if (strcmp(cmd, "end") == 0)
+	{
+		CheckHits();
+		map.Free();
+	}
+	else Fail("unknown command %s", cmd);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *name = (argc > 1) ? argv[1] : TEST_FILE;
+	FILE *f = fopen(name, "r");
+	if (!f) { printf("cannot open %s\n", name); return 1; }
+
+	CheckThresholds();
+
+	char s[1024];
+	int tests = 0;
+	while (fgets(s, sizeof(s), f))
+	{
+		line++;
+		char cmd[16];
+		int n;
+		if (s[0] == '#' || sscanf(s, "%15s%n", cmd, &n) != 1) continue;
+		if (strcmp(cmd, "end") == 0) tests++;
+		Command(cmd, s + n);
+	}
+	fclose(f);
+
+	if (tests == 0) { printf("%s: no test\n", name); return 1; }
+	printf("pixel_map_test: %i tests, %i failures\n", tests, failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,42 @@
+// sim.h
+// Internal interface of the DTB simulator (host build).
+
+#pragma once
+
+#include "cstdint.h"
+
+
+// --- sim_hal.cc -------------------------------------------------------
+
+// host time since start in clocks of the given frequency (MHz)
+uint64_t sim_Clocks(uint32_t mhz);
+
+// sys_timer registers
+uint32_t sim_TimerRead(uint32_t reg);
+void sim_TimerWrite(uint32_t reg, uint32_t value);
+
+// maps a 32 bit bus address of the DAQ DMA to host memory
+void* sim_Memory(uint32_t addr);
+
+
+// --- sim_regs.cc ------------------------------------------------------
+
+// ROCs with inverted row address (psi46digV2)
+extern bool sim_roc_inverted;
+
+// threshold model of an enabled pixel: lowest firing Vcal (low range),
+// also the reference of the FindLevel test of dtb_bench
+inline int32_t sim_Threshold(uint8_t trim, uint8_t vthrcomp, uint8_t col, uint8_t row)
+{
+	return 20 + 2*trim + (255 - vthrcomp)/4 + (col*7 + row*13) % 11 - 5;
+}
+
+// USB FIFO over a TCP socket, one host connection at a time
+bool sim_UsbListen(uint16_t port);
+void sim_UsbSend(const void *buffer, uint32_t size);
+
+
+// --- sim_eth.cc -------------------------------------------------------
+
+// Ethernet frames in UDP datagrams
+bool sim_EthListen(uint16_t port);
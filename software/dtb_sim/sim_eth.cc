@@ -0,0 +1,81 @@
+// sim_eth.cc
+// Ethernet MAC of the host build (tse_Init, tse_Send, tse_Recv of
+// tse_mac.cc): each UDP datagram on the local port carries one Ethernet
+// frame without FCS. Frames are sent to the address of the last
+// datagram received, a host tool talks to the board like on a direct
+// link, no network interface or switch is involved.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include "ethernet.h"
+#include "sim.h"
+
+
+static int sim_eth = -1;
+static struct sockaddr_in sim_eth_peer;
+static bool sim_eth_connected = false;
+
+
+bool sim_EthListen(uint16_t port)
+{
+	sim_eth = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sim_eth < 0) return false;
+
+	struct sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	a.sin_port = htons(port);
+	if (bind(sim_eth, (struct sockaddr*)&a, sizeof(a)) < 0)
+	{
+		close(sim_eth);
+		sim_eth = -1;
+		return false;
+	}
+	fcntl(sim_eth, F_SETFL, O_NONBLOCK);
+	return true;
+}
+
+
+bool tse_Init(const uint8_t *mac)
+{
+	return sim_eth >= 0;
+}
+
+
+bool tse_Send(const void *head, uint16_t head_size, const void *data, uint16_t data_size)
+{
+	if (!sim_eth_connected) return false;
+	uint8_t frame[ETH_FRAME_SIZE];
+	if (head_size + data_size > ETH_FRAME_SIZE) return false;
+	memcpy(frame, head, head_size);
+	if (data_size) memcpy(frame + head_size, data, data_size);
+
+	// a full socket buffer is a busy wire
+	while (sendto(sim_eth, frame, head_size + data_size, 0,
+		(struct sockaddr*)&sim_eth_peer, sizeof(sim_eth_peer)) < 0)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) return false;
+		usleep(10);
+	}
+	return true;
+}
+
+
+uint16_t tse_Recv(void *frame)
+{
+	if (sim_eth < 0) return 0;
+	struct sockaddr_in a;
+	socklen_t alen = sizeof(a);
+	ssize_t n = recvfrom(sim_eth, frame, ETH_FRAME_SIZE, MSG_DONTWAIT | MSG_TRUNC,
+		(struct sockaddr*)&a, &alen);
+	if (n <= 0 || n > ETH_FRAME_SIZE) return 0;
+	sim_eth_peer = a;
+	sim_eth_connected = true;
+	return uint16_t(n);
+}
@@ -0,0 +1,232 @@
+// sim_hal.cc
+// Nios II HAL replacement of the host build: sys_timer and tick
+// interrupt, interrupt enable, cache, flash and SD card stubs, DAQ memory
+// mapping and the USB transmit SGDMA controller.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <malloc.h>
+#include <pthread.h>
+#include "system.h"
+#include "altera_avalon_timer_regs.h"
+#include "sys/alt_alarm.h"
+#include "sys/alt_cache.h"
+#include "sys/alt_flash.h"
+#include "sys/alt_irq.h"
+#include "sys/alt_stdio.h"
+#include "sgdma.h"
+#include "ff.h"
+#include "sim.h"
+
+
+// === time =================================================================
+
+static struct timespec sim_start;
+
+uint64_t sim_Clocks(uint32_t mhz)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	uint64_t ns = uint64_t(t.tv_sec - sim_start.tv_sec)*1000000000
+		+ t.tv_nsec - sim_start.tv_nsec;
+	return ns*mhz/1000;
+}
+
+
+// === interrupts ===========================================================
+
+// The tick thread is the only interrupt source. It takes this lock, a
+// cleared PIE bit holds it like the disabled interrupts of the cpu.
+static pthread_mutex_t sim_irq_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t sim_status = NIOS2_STATUS_PIE_MSK;
+
+static void sim_SgdmaIrq();
+
+unsigned int sim_rdctl(int reg)
+{
+	return (reg == 0) ? sim_status : 0;
+}
+
+
+void sim_wrctl(int reg, unsigned int value)
+{
+	if (reg != 0) return;
+	bool pie = sim_status & NIOS2_STATUS_PIE_MSK;
+	sim_status = value;
+	if (pie && !(value & NIOS2_STATUS_PIE_MSK)) pthread_mutex_lock(&sim_irq_lock);
+	else if (!pie && (value & NIOS2_STATUS_PIE_MSK))
+	{
+		pthread_mutex_unlock(&sim_irq_lock);
+		sim_SgdmaIrq();
+	}
+}
+
+
+// === sys_timer ============================================================
+
+#define SIM_TIMER_CLOCKS (SYS_TIMER_LOAD_VALUE + 1)
+
+volatile alt_u32 _alt_nticks = 0;
+alt_u32 _alt_tick_rate = 1000/SYS_TIMER_PERIOD;
+
+static uint32_t sim_snap;
+
+// counter reloaded but tick not yet processed
+static bool sim_TimerTimeout()
+{
+	return sim_Clocks(SYS_TIMER_FREQ/1000000)/SIM_TIMER_CLOCKS != _alt_nticks;
+}
+
+
+uint32_t sim_TimerRead(uint32_t reg)
+{
+	switch (reg)
+	{
+	case ALTERA_AVALON_TIMER_STATUS_REG:
+		return sim_TimerTimeout() ? ALTERA_AVALON_TIMER_STATUS_TO_MSK : 0;
+	case ALTERA_AVALON_TIMER_SNAPL_REG: return sim_snap & 0xffff;
+	case ALTERA_AVALON_TIMER_SNAPH_REG: return sim_snap >> 16;
+	}
+	return 0;
+}
+
+
+void sim_TimerWrite(uint32_t reg, uint32_t value)
+{ // a write to a snap register latches the down counter
+	if (reg == ALTERA_AVALON_TIMER_SNAPL_REG || reg == ALTERA_AVALON_TIMER_SNAPH_REG)
+		sim_snap = SYS_TIMER_LOAD_VALUE
+			- sim_Clocks(SYS_TIMER_FREQ/1000000) % SIM_TIMER_CLOCKS;
+}
+
+
+// sys_timer interrupt
+static void* sim_TickThread(void *)
+{
+	struct timespec t = { 0, 1000000 };
+	while (true)
+	{
+		nanosleep(&t, 0);
+		pthread_mutex_lock(&sim_irq_lock);
+		while (sim_TimerTimeout()) _alt_nticks++;
+		pthread_mutex_unlock(&sim_irq_lock);
+	}
+	return 0;
+}
+
+
+// === DAQ memory ===========================================================
+
+// The DMA registers hold 32 bit addresses. All allocations are taken
+// from the brk heap, its upper address bits complete a bus address.
+static uintptr_t sim_memory_hi;
+
+void* sim_Memory(uint32_t addr)
+{
+	return (void*)(sim_memory_hi | addr);
+}
+
+
+// runs before the constructor of the global CTestboard
+__attribute__((constructor(101))) void sim_HalInit()
+{
+	clock_gettime(CLOCK_MONOTONIC, &sim_start);
+
+	mallopt(M_MMAP_MAX, 0);
+	void *p = malloc(1);
+	sim_memory_hi = uintptr_t(p) & ~uintptr_t(0xffffffff);
+	free(p);
+
+	pthread_t tick;
+	pthread_create(&tick, 0, sim_TickThread, 0);
+}
+
+
+// === stdio, cache, flash, SD card =========================================
+
+int alt_putstr(const char *str) { return fputs(str, stdout); }
+
+void alt_dcache_flush(void *start, alt_u32 len) {}
+void alt_dcache_flush_no_writeback(void *start, alt_u32 len) {}
+void alt_dcache_flush_all() {}
+void alt_icache_flush(void *start, alt_u32 len) {}
+void alt_icache_flush_all() {}
+
+// no flash memory: firmware upgrades fail
+alt_flash_fd* alt_flash_open_dev(const char *name) { return 0; }
+void alt_flash_close_dev(alt_flash_fd *fd) {}
+
+// no SD card: the default configuration is used
+FRESULT f_mount(uint8_t drive, FATFS *fs) { return FR_NOT_READY; }
+FRESULT f_open(FIL *f, const TCHAR *path, uint8_t mode) { return FR_NOT_READY; }
+FRESULT f_close(FIL *f) { return FR_OK; }
+TCHAR* f_gets(TCHAR *buffer, int len, FIL *f) { return 0; }
+
+
+// === USB transmit SGDMA ==================================================
+
+// Controller model for the transmit engine of sgdma.cc (CDma). A chain is
+// sent to the socket when it is started, then the completion interrupt is
+// raised. Like the hardware, which writes back the last descriptor before
+// it clears BUSY, the controller is still busy for the next start
+// (-EBUSY).
+static alt_sgdma_dev sim_sgdma;
+static bool sim_sgdma_busy = false;
+static bool sim_sgdma_irq = false;  // completion interrupt pending
+
+alt_sgdma_dev* alt_avalon_sgdma_open(const char *name)
+{
+	if (strcmp(name, USB_TX_DMA_NAME) != 0) return 0;
+	sim_sgdma.name = USB_TX_DMA_NAME;
+	sim_sgdma.base = (void*)USB_TX_DMA_BASE;
+	return &sim_sgdma;
+}
+
+
+void alt_avalon_sgdma_register_callback(alt_sgdma_dev *dev,
+	alt_avalon_sgdma_callback callback, alt_u32 chain_control, void *context)
+{
+	dev->callback = callback;
+	dev->callback_context = context;
+	dev->chain_control = chain_control;
+}
+
+
+// interrupt entry if enabled, else at the next enable
+static void sim_SgdmaIrq()
+{
+	if (!sim_sgdma_irq || !(sim_status & NIOS2_STATUS_PIE_MSK)) return;
+	sim_sgdma_irq = false;
+	sim_wrctl(0, sim_status & ~NIOS2_STATUS_PIE_MSK);
+	sim_sgdma.callback(sim_sgdma.callback_context);
+	sim_wrctl(0, sim_status | NIOS2_STATUS_PIE_MSK);
+}
+
+
+int alt_avalon_sgdma_do_async_transfer(alt_sgdma_dev *dev, alt_sgdma_descriptor *desc)
+{
+	if (sim_sgdma_busy)
+	{
+		sim_sgdma_busy = false;
+		return -EBUSY;
+	}
+
+	while (desc->control & ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_OWNED_BY_HW_MSK)
+	{
+		sim_UsbSend(desc->read_addr, desc->bytes_to_transfer);
+		desc->actual_bytes_transferred = desc->bytes_to_transfer;
+		desc->status = ALTERA_AVALON_SGDMA_DESCRIPTOR_STATUS_TERMINATED_BY_EOP_MSK;
+		desc->control &= ~ALTERA_AVALON_SGDMA_DESCRIPTOR_CONTROL_OWNED_BY_HW_MSK;
+		desc = (alt_sgdma_descriptor*)desc->next;
+	}
+	sim_sgdma_busy = true;
+
+	if (dev->callback)
+	{
+		sim_sgdma_irq = true;
+		sim_SgdmaIrq();
+	}
+	return 0;
+}
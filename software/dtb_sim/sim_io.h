@@ -0,0 +1,43 @@
+// sim_io.h
+// Forced include of the host build (g++ -include sim_io.h).
+// Replaces the Nios II I/O instructions used by io.h and nios2.h:
+// accesses to the peripheral address range go to the peripheral
+// model (sim_regs.cc), all other addresses are host memory.
+
+#ifndef SIM_IO_H
+#define SIM_IO_H
+
+#define DTB_SIM
+
+#ifndef SYSTEM_BUS_WIDTH
+#define SYSTEM_BUS_WIDTH 32
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned int sim_rd(const volatile void *addr, int size);
+void sim_wr(volatile void *addr, unsigned int value, int size);
+
+// status register (PIE bit) of the simulated cpu
+unsigned int sim_rdctl(int reg);
+void sim_wrctl(int reg, unsigned int value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define __builtin_ldwio(a)    ((int)sim_rd((a), 4))
+#define __builtin_ldhio(a)    ((short)sim_rd((a), 2))
+#define __builtin_ldhuio(a)   ((unsigned short)sim_rd((a), 2))
+#define __builtin_ldbio(a)    ((signed char)sim_rd((a), 1))
+#define __builtin_ldbuio(a)   ((unsigned char)sim_rd((a), 1))
+#define __builtin_stwio(a, d) sim_wr((a), (unsigned int)(d), 4)
+#define __builtin_sthio(a, d) sim_wr((a), (unsigned int)(d), 2)
+#define __builtin_stbio(a, d) sim_wr((a), (unsigned int)(d), 1)
+
+#define __builtin_rdctl(r)    sim_rdctl(r)
+#define __builtin_wrctl(r, d) sim_wrctl((r), (unsigned int)(d))
+
+#endif
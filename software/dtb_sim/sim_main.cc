@@ -0,0 +1,53 @@
+// sim_main.cc
+// DTB simulator: the firmware on the host with the peripheral model,
+// the RPC protocol of the USB interface on a TCP socket.
+//
+//   dtb_sim [-i] [port]   (default port 10100, localhost only)
+//
+//   -i  ROCs with inverted row address (psi46digV2)
+//
+// The Ethernet interface is on the same port number (UDP), the board
+// has the MAC address SIM_MAC_ADDRESS.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pixel_dtb.h"
+#include "dtb_config.h"
+#include "sim.h"
+
+
+#define SIM_PORT 10100
+#define SIM_MAC_ADDRESS 0x02000000D7B0ULL  // locally administered
+
+
+CTestboard tb;
+
+
+int main(int argc, char *argv[])
+{
+	setvbuf(stdout, 0, _IOLBF, 0);
+	uint16_t port = SIM_PORT;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-i") == 0) sim_roc_inverted = true;
+		else port = atoi(argv[i]);
+	}
+	if (!sim_UsbListen(port))
+	{
+		printf("cannot listen on port %u\n", port);
+		return 1;
+	}
+	printf("DTB simulator, listening on port %u\n", port);
+
+	// no SD card: default configuration
+	dtbConfig.Init();
+
+	dtbConfig.mac_address = SIM_MAC_ADDRESS;
+	if (!sim_EthListen(port) || !tb.Ethernet_Init())
+		printf("no Ethernet interface\n");
+
+	rpc_Dispatcher(*tb.GetIo());
+
+	return 0;
+}
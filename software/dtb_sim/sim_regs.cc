@@ -0,0 +1,546 @@
+// sim_regs.cc
+// Peripheral model of the host build. The peripherals used by the
+// firmware are modeled at register level:
+//   sys_timer      counter snapshot (sim_hal.cc)
+//   daq_dma        DMA writer of the 8 DAQ channels (daq_dma32.v)
+//   psi2c          ROC commands are decoded into a ROC model
+//   patterngen     single, trigger and loop mode, runs the pattern
+//   eventgen       data generator
+//   usb2           FT232 FIFO on a TCP socket
+// All other registers read 0, which keeps the status polling loops of
+// the firmware from waiting.
+//
+// Each pattern with a token or trigger produces one event in all running
+// DAQ channels with a data source: channel 0 gets the data generator or
+// DESER160 (first ROC), the channels of an enabled DESER400 get a TBM
+// event with 8 ROCs each. A ROC reports the calibrated pixels that are
+// enabled and above their threshold (Vcal, VthrComp, trim bits).
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include "pixel_dtb.h"
+#include "sim.h"
+
+
+#define SIM_IO_BASE 0x08000000
+#define SIM_IO_END  0x09000000
+
+#define SIM_IN(base, span) (addr >= (base) && addr < (base) + (span))
+
+
+// === DAQ DMA ==============================================================
+
+struct CSimDaq
+{
+	uint32_t base, size, rp, wp, thres;
+	bool running, ram_ovfl;
+
+	uint32_t Fill() { return (wp >= rp) ? wp - rp : wp - rp + size; }
+	void Put(uint16_t x);
+	uint32_t Read(uint32_t reg);
+	void Write(uint32_t reg, uint32_t value);
+};
+
+static CSimDaq sim_daq[8];  // static zero init: used by the CTestboard constructor
+
+static const uint32_t sim_daq_base[8] =
+{
+	DAQ_DMA_0_BASE, DAQ_DMA_1_BASE, DAQ_DMA_2_BASE, DAQ_DMA_3_BASE,
+	DAQ_DMA_4_BASE, DAQ_DMA_5_BASE, DAQ_DMA_6_BASE, DAQ_DMA_7_BASE
+};
+
+
+// stops with the write pointer on the read pointer at memory overflow
+void CSimDaq::Put(uint16_t x)
+{
+	if (!running || size == 0) return;
+	((uint16_t*)sim_Memory(base))[wp] = x;
+	uint32_t next = (wp + 1 == size) ? 0 : wp + 1;
+	if (next == rp) { ram_ovfl = true; running = false; }
+	wp = next;
+}
+
+
+uint32_t CSimDaq::Read(uint32_t reg)
+{
+	switch (reg)
+	{
+	case DAQ_MEM_BASE:  return base;
+	case DAQ_MEM_SIZE:  return size;
+	case DAQ_MEM_READ:  return rp;
+	case DAQ_MEM_WRITE: return wp;
+	case DAQ_STATUS:
+		return (running ? DAQ_RUNNING : 0) | (ram_ovfl ? DAQ_MEM_OVFL : 0)
+			| ((thres && Fill() >= thres) ? DAQ_THRES : 0);
+	case DAQ_MEM_THRES: return thres;
+	}
+	return 0;
+}
+
+
+void CSimDaq::Write(uint32_t reg, uint32_t value)
+{
+	if (reg == DAQ_MEM_THRES) { thres = value & 0x3ffffff; return; }
+	if (reg == DAQ_CONTROL)
+	{
+		if (value & 1)
+		{
+			if (!running) { rp = wp = 0; ram_ovfl = false; running = true; }
+		}
+		else running = false;
+		return;
+	}
+	if (reg == DAQ_MEM_READ) { rp = value & 0x3ffffff; return; }
+	if (running) return;
+	if (reg == DAQ_MEM_BASE) base = value & ~1;  // 32 bit host address
+	else if (reg == DAQ_MEM_SIZE) size = value & 0x3ffffff;
+}
+
+
+// === ROC model ============================================================
+
+#define SIM_DAC_VTHRCOMP  12
+#define SIM_DAC_VCAL      25
+#define SIM_DAC_CTRLREG  253
+#define SIM_MAXCALS      256
+
+struct CSimRoc
+{
+	bool used;
+	uint8_t dac[256];
+	uint8_t pix[ROC_NUMCOLS*ROC_NUMROWS];  // M - - - 8 4 2 1
+	uint32_t dcolEnable;
+	uint16_t ncal;
+	uint16_t cal[SIM_MAXCALS];  // (col << 8) + row
+
+	void Init();
+	void Command(uint8_t cmd, const uint8_t *data, uint8_t n);
+	uint16_t Hits(uint32_t *raw);
+};
+
+static CSimRoc sim_roc[MOD_NUMROCS];
+bool sim_roc_inverted = false;
+static uint8_t sim_colcode[256], sim_rowcode[256];
+
+
+// power up: all pixels enabled with trim 15, columns disabled
+void CSimRoc::Init()
+{
+	used = false;
+	memset(dac, 0, sizeof(dac));
+	memset(pix, 0x8f, sizeof(pix));
+	dcolEnable = 0;
+	ncal = 0;
+}
+
+
+void CSimRoc::Command(uint8_t cmd, const uint8_t *data, uint8_t n)
+{
+	used = true;
+	switch (cmd)
+	{
+	case 0x01: // ClrCal
+		ncal = 0;
+		break;
+	case 0x02: // Cal
+		if (n < 3 || ncal >= SIM_MAXCALS) break;
+		cal[ncal++] = (sim_colcode[data[0]] << 8) + sim_rowcode[data[1]];
+		break;
+	case 0x04: // pixel bits or double column enable
+		if (n < 3) break;
+		{
+			uint8_t col = sim_colcode[data[0]];
+			if (col >= ROC_NUMCOLS) break;
+			if (data[1] == 0x40)
+			{
+				uint32_t dc = 1 << (col >> 1);
+				if (data[2] & 0x80) dcolEnable |= dc; else dcolEnable &= ~dc;
+			}
+			else
+			{
+				uint8_t row = sim_rowcode[data[1]];
+				if (row < ROC_NUMROWS) pix[col*ROC_NUMROWS + row] = data[2];
+			}
+		}
+		break;
+	case 0x08: // DAC
+		if (n >= 2) dac[data[0]] = data[1];
+		break;
+	}
+}
+
+
+// raw 24 bit pixel hits (address and pulse height) of a calibrate
+uint16_t CSimRoc::Hits(uint32_t *raw)
+{
+	int32_t vcal = dac[SIM_DAC_VCAL];
+	if (dac[SIM_DAC_CTRLREG] & 0x04) vcal *= 7;
+
+	uint16_t n = 0;
+	for (uint16_t i = 0; i < ncal; i++)
+	{
+		uint8_t col = cal[i] >> 8, row = cal[i] & 0xff;
+		if (col >= ROC_NUMCOLS || row >= ROC_NUMROWS) continue;
+		if (!(dcolEnable & (1 << (col >> 1)))) continue;
+		uint8_t p = pix[col*ROC_NUMROWS + row];
+		if (!(p & 0x80)) continue;
+
+		int32_t thr = sim_Threshold(p & 0x0f, dac[SIM_DAC_VTHRCOMP], col, row);
+		if (vcal < thr) continue;
+		uint32_t ph = 20 + vcal - thr;
+		if (ph > 255) ph = 255;
+
+		// double column, pixel address in the double column (base 6 digits)
+		uint32_t c = col/2;
+		uint32_t r = 2*(ROC_NUMROWS - row) + (col & 1);
+		raw[n++] = ((c/6) << 21) + ((c%6) << 18)
+			+ ((r/36) << 15) + (((r/6)%6) << 12) + ((r%6) << 9)
+			+ ((ph & 0xf0) << 1) + (ph & 0x0f);
+		if (sim_roc_inverted) raw[n-1] ^= 0x03fe00;
+	}
+	return n;
+}
+
+
+// === psi2c ================================================================
+
+// register writes of the psi2c fifo, decoded at go
+static uint16_t sim_i2c[PSI2C_FIFO_SIZE];
+static uint16_t sim_i2c_n;
+
+// A ROC command is closed by a stop (register 1). The last address
+// byte (register 3, or register 5 for short commands) follows the hub
+// address of a module, the data bytes follow the address byte.
+static void sim_I2cGo()
+{
+	int16_t addr = -1;
+	uint8_t data[8], n = 0;
+	for (uint16_t i = 0; i < sim_i2c_n; i++)
+	{
+		uint8_t reg = sim_i2c[i] >> 12;
+		uint8_t value = sim_i2c[i] & 0xff;
+		switch (reg)
+		{
+		case 3:
+		case 5:
+			addr = value;
+			n = 0;
+			break;
+		case 2:
+		case 4:
+			if (n < sizeof(data)) data[n++] = value;
+			break;
+		case 1:
+			if (addr >= 0) sim_roc[addr >> 4].Command(addr & 0x0f, data, n);
+			addr = -1;
+			n = 0;
+			break;
+		}
+	}
+	sim_i2c_n = 0;
+}
+
+
+static void sim_I2cWrite(uint32_t reg, uint32_t value)
+{
+	if (reg == 0) sim_I2cGo();
+	else if (sim_i2c_n < PSI2C_FIFO_SIZE) sim_i2c[sim_i2c_n++] = (reg << 12) + (value & 0xfff);
+}
+
+
+// === event generation =====================================================
+
+static uint32_t sim_deser160;    // DESER160 pio (bit 3 = enable)
+static uint32_t sim_deser400;    // DESER400 enable bits
+static uint32_t sim_eventgen;    // data generator on
+static uint16_t sim_eventcount;  // data generator counter
+static uint8_t  sim_tbmcount;
+
+static void sim_Deser160Event(CSimDaq &daq, bool cal)
+{
+	CSimRoc *roc = sim_roc;
+	for (uint8_t i = 0; i < MOD_NUMROCS; i++)
+		if (sim_roc[i].used) { roc = sim_roc + i; break; }
+
+	uint32_t raw[SIM_MAXCALS];
+	uint16_t n = cal ? roc->Hits(raw) : 0;
+	daq.Put(0x87f8);
+	for (uint16_t i = 0; i < n; i++)
+	{
+		daq.Put((raw[i] >> 12) & 0x0fff);
+		daq.Put(raw[i] & 0x0fff);
+	}
+}
+
+
+static void sim_ModuleEvent(CSimDaq &daq, uint8_t core, bool cal)
+{
+	daq.Put(0xa000 + sim_tbmcount);
+	daq.Put(0x8000);
+	uint32_t raw[SIM_MAXCALS];
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		uint16_t n = cal ? sim_roc[core*8 + i].Hits(raw) : 0;
+		daq.Put(0x4000);
+		for (uint16_t k = 0; k < n; k++)
+		{
+			daq.Put((raw[k] >> 12) & 0x0fff);
+			daq.Put(0x2000 + (raw[k] & 0x0fff));
+		}
+	}
+	daq.Put(0xe000);
+	daq.Put(0xc000);
+}
+
+
+static void sim_Event(bool cal)
+{
+	for (uint8_t ch = 0; ch < 8; ch++)
+	{
+		CSimDaq &daq = sim_daq[ch];
+		if (!daq.running) continue;
+		if (ch == 0 && (sim_eventgen & 1))
+		{
+			daq.Put(0x87f8);
+			daq.Put(sim_eventcount++ & 0x0fff);
+		}
+		else if (ch == 0 && (sim_deser160 & 0x08)) sim_Deser160Event(daq, cal);
+		else if (sim_deser400 & (1 << (ch >> 1))) sim_ModuleEvent(daq, ch & 1, cal);
+	}
+	sim_tbmcount++;
+}
+
+
+// === pattern generator ====================================================
+
+static uint16_t sim_pattern[256];
+static uint32_t sim_pg_period;
+static bool     sim_pg_loop;
+static uint64_t sim_pg_next;   // 40 MHz clock of the next loop pattern
+
+// runs the pattern up to the entry with delay 0
+static void sim_Pattern()
+{
+	bool cal = false;
+	for (uint16_t i = 0; i < 256; i++)
+	{
+		uint16_t cmd = sim_pattern[i];
+		if (cmd & PG_CAL) cal = true;
+		if (cmd & (PG_TOK | PG_TRG)) { sim_Event(cal); cal = false; }
+		if ((cmd & 0xff) == 0) break;
+	}
+}
+
+
+static void sim_PgWrite(uint32_t reg, uint32_t value)
+{
+	if (reg == 4) { sim_pg_period = value; return; }
+	if (reg != 0) return;
+	sim_pg_loop = false;
+	if (value & 0x80)
+	{
+		if (value & 0x03) sim_Pattern();
+		else if ((value & 0x04) && sim_pg_period)
+		{
+			sim_pg_loop = true;
+			sim_pg_next = sim_Clocks(40);
+		}
+	}
+}
+
+
+// loop mode: patterns due since the last call (max 1000)
+static void sim_PgService()
+{
+	if (!sim_pg_loop) return;
+	uint64_t now = sim_Clocks(40);
+	for (uint16_t i = 0; i < 1000 && sim_pg_next <= now; i++)
+	{
+		sim_Pattern();
+		sim_pg_next += sim_pg_period;
+	}
+	if (sim_pg_next <= now) sim_pg_next = now;
+}
+
+
+// === USB ==================================================================
+
+#define SIM_USB_RXSIZE 65536
+#define SIM_USB_IDLE   1000  // sleep after this number of empty polls
+
+static int sim_usb_listen = -1;
+static int sim_usb = -1;
+static uint8_t sim_usb_rx[SIM_USB_RXSIZE];
+static uint32_t sim_usb_rxpos, sim_usb_rxsize;
+static uint32_t sim_usb_idle;
+
+bool sim_UsbListen(uint16_t port)
+{
+	sim_usb_listen = socket(AF_INET, SOCK_STREAM, 0);
+	if (sim_usb_listen < 0) return false;
+	int on = 1;
+	setsockopt(sim_usb_listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	struct sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	a.sin_port = htons(port);
+	if (bind(sim_usb_listen, (struct sockaddr*)&a, sizeof(a)) < 0
+		|| listen(sim_usb_listen, 1) < 0) return false;
+	fcntl(sim_usb_listen, F_SETFL, O_NONBLOCK);
+	return true;
+}
+
+
+static void sim_UsbClose()
+{
+	close(sim_usb);
+	sim_usb = -1;
+	sim_usb_rxpos = sim_usb_rxsize = 0;
+	printf("host disconnected\n");
+}
+
+
+static bool sim_UsbRxFull()
+{
+	if (sim_usb_rxpos < sim_usb_rxsize) return true;
+
+	if (sim_usb < 0)
+	{
+		sim_usb = accept(sim_usb_listen, 0, 0);
+		if (sim_usb >= 0)
+		{
+			int on = 1;
+			setsockopt(sim_usb, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+			printf("host connected\n");
+		}
+	}
+	if (sim_usb >= 0)
+	{
+		ssize_t n = recv(sim_usb, sim_usb_rx, SIM_USB_RXSIZE, MSG_DONTWAIT);
+		if (n > 0)
+		{
+			sim_usb_rxpos = 0;
+			sim_usb_rxsize = n;
+			sim_usb_idle = 0;
+			return true;
+		}
+		if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) sim_UsbClose();
+	}
+
+	if (++sim_usb_idle >= SIM_USB_IDLE) { usleep(100); sim_usb_idle = 0; }
+	return false;
+}
+
+
+void sim_UsbSend(const void *buffer, uint32_t size)
+{
+	const uint8_t *p = (const uint8_t*)buffer;
+	while (size && sim_usb >= 0)
+	{
+		ssize_t n = send(sim_usb, p, size, MSG_NOSIGNAL);
+		if (n <= 0) { sim_UsbClose(); return; }
+		p += n;
+		size -= n;
+	}
+}
+
+
+static uint32_t sim_UsbRead(uint32_t reg)
+{
+	if (reg == 1) return sim_UsbRxFull() ? 1 : 0;
+	return (sim_usb_rxpos < sim_usb_rxsize) ? sim_usb_rx[sim_usb_rxpos++] : 0;
+}
+
+
+// === register access ======================================================
+
+static bool sim_init = false;
+
+static void sim_RegInit()
+{
+	// inverse of CTestboard::COLCODE and ROWCODE
+	for (uint16_t x = 0; x < 256; x++)
+	{
+		sim_colcode[((x >> 1) & 0x7e) ^ x] = x;
+		sim_rowcode[(x >> 1) ^ x] = x;
+	}
+	for (uint8_t i = 0; i < MOD_NUMROCS; i++) sim_roc[i].Init();
+	sim_init = true;
+}
+
+
+static uint32_t sim_Read(uint32_t addr)
+{
+	for (uint8_t ch = 0; ch < 8; ch++)
+		if (SIM_IN(sim_daq_base[ch], 0x20))
+		{
+			sim_PgService();
+			return sim_daq[ch].Read(addr - sim_daq_base[ch]);
+		}
+	if (SIM_IN(SYS_TIMER_BASE, 0x20)) return sim_TimerRead((addr - SYS_TIMER_BASE)/4);
+	if (SIM_IN(USB2_BASE, 2))
+	{
+		sim_PgService();
+		return sim_UsbRead(addr - USB2_BASE);
+	}
+	return 0;
+}
+
+
+static void sim_Write(uint32_t addr, uint32_t value, int size)
+{
+	if (!sim_init) sim_RegInit();
+
+	for (uint8_t ch = 0; ch < 8; ch++)
+		if (SIM_IN(sim_daq_base[ch], 0x20))
+		{
+			sim_daq[ch].Write(addr - sim_daq_base[ch], value);
+			return;
+		}
+	if (SIM_IN(SYS_TIMER_BASE, 0x20)) sim_TimerWrite((addr - SYS_TIMER_BASE)/4, value);
+	else if (SIM_IN(PSI2C_BASE, 0x20)) sim_I2cWrite((addr - PSI2C_BASE)/4, value);
+	else if (SIM_IN(PATTERNGEN_DATA_BASE, 0x200))
+	{
+		uint32_t i = (addr - PATTERNGEN_DATA_BASE)/2;
+		if (size == 2) sim_pattern[i] = value;
+	}
+	else if (SIM_IN(PATTERNGEN_CTRL_BASE, 8)) sim_PgWrite(addr - PATTERNGEN_CTRL_BASE, value);
+	else if (addr == EVENTGEN_BASE) sim_eventgen = value;
+	else if (addr == EVENTGEN_BASE + 1) sim_eventcount = value;
+	else if (addr == DESER160_BASE) sim_deser160 = value;
+	else if (addr == DESER400_CTRL_BASE + DESER_ENABLE) sim_deser400 = value;
+}
+
+
+unsigned int sim_rd(const volatile void *addr, int size)
+{
+	uintptr_t a = uintptr_t(addr);
+	if (a >= SIM_IO_BASE && a < SIM_IO_END) return sim_Read(a);
+	switch (size)
+	{
+	case 1: return *(const volatile uint8_t*)addr;
+	case 2: return *(const volatile uint16_t*)addr;
+	}
+	return *(const volatile uint32_t*)addr;
+}
+
+
+void sim_wr(volatile void *addr, unsigned int value, int size)
+{
+	uintptr_t a = uintptr_t(addr);
+	if (a >= SIM_IO_BASE && a < SIM_IO_END) { sim_Write(a, value, size); return; }
+	switch (size)
+	{
+	case 1: *(volatile uint8_t*)addr = value; break;
+	case 2: *(volatile uint16_t*)addr = value; break;
+	default: *(volatile uint32_t*)addr = value;
+	}
+}
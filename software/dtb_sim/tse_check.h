@@ -0,0 +1,18 @@
+// tse_check.h
+// Compile check of tse_mac.cc (make tse_check): system.h of a hardware
+// design with the Triple-Speed Ethernet MAC and its SGDMA controllers.
+// The object is not linked, the simulator replaces the MAC by sim_eth.cc.
+
+#ifndef TSE_CHECK_H
+#define TSE_CHECK_H
+
+#include "system.h"
+
+#undef  DESCRIPTOR_MEMORY_SIZE_VALUE
+#define DESCRIPTOR_MEMORY_SIZE_VALUE 512
+
+#define TSE_MAC_BASE      0x8404000
+#define TSE_SGDMA_TX_NAME "/dev/tse_sgdma_tx"
+#define TSE_SGDMA_RX_NAME "/dev/tse_sgdma_rx"
+
+#endif